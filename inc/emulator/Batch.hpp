@@ -0,0 +1,27 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Options.hpp"
+using namespace std;
+
+struct RunResult {
+  string program;
+  string state;
+  uint64_t instructions = 0;
+  string output;
+};
+
+// Runs one program headless and captures its console output and final
+// processor state.
+RunResult runHeadless(const string& program, Options options);
+
+// Runs all programs on a thread pool. Each run's output is written to
+// program.out, program.in (if present) replaces the -input of that run. A
+// line per run with its exit state and instruction count goes to stdout.
+// Returns 0 if every run halted.
+int runBatch(const vector<string>& programs, const Options& options);
+
+#endif //BATCH_HPP
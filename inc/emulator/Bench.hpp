@@ -0,0 +1,28 @@
+#ifndef BENCH_HPP
+#define BENCH_HPP
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Options.hpp"
+using namespace std;
+
+struct BenchResult {
+  string program;
+  string state;
+  uint64_t instructions = 0;
+  // Best host time of the runs, without loading the program.
+  double seconds = 0;
+  long peakRssKb = 0;
+};
+
+// Runs every program headless, one after the other, each in a child process
+// of its own so its peak RSS is not mixed up with the others'. Every program
+// runs benchRuns times and the fastest run counts. Writes a JSON report
+// with guest MIPS, host ns per instruction and peak RSS to stdout. With a
+// baseline report given, compares MIPS against it and counts a program that
+// got more than benchTolerance percent slower as a regression. Returns 0 if
+// every program halted without a regression.
+int runBenchmark(const vector<string>& programs, const Options& options);
+
+#endif //BENCH_HPP
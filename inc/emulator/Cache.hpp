@@ -0,0 +1,95 @@
+#ifndef CACHE_HPP
+#define CACHE_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "SymbolRanges.hpp"
+using namespace std;
+
+enum class Replacement {LRU, FIFO, RANDOM};
+
+// Geometry of one cache level. Sizes are in bytes and powers of two.
+struct CacheLevel {
+  uint32_t size;
+  uint32_t ways;
+  uint32_t lineSize;
+  Replacement policy = Replacement::LRU;
+
+  // Parses "size:ways:line[:lru|fifo|random]", size may end in k or m.
+  static CacheLevel parse(const string& spec);
+};
+
+// One set-associative, write-back, write-allocate cache level.
+class Cache {
+public:
+  Cache(const CacheLevel& level);
+
+  // Looks up the line holding address and fills it on a miss. Returns true
+  // on a hit. A miss that evicts a dirty line sets writeback and stores the
+  // address of that line in evicted.
+  bool access(uint32_t address, bool write, bool& writeback, uint32_t& evicted);
+
+  const CacheLevel& level() const {return config; }
+
+  uint64_t hits = 0, misses = 0, writebacks = 0;
+
+private:
+  struct Line {
+    uint32_t tag;
+    bool valid = false;
+    bool dirty = false;
+    uint64_t stamp = 0;
+  };
+
+  CacheLevel config;
+  uint32_t lineBits, setMask;
+  vector<Line> lines;
+  uint64_t clock = 0;
+  uint32_t random = 0x2545F491;
+
+  uint32_t victim(Line* set);
+};
+
+// Memory hierarchy with split L1 caches in front of a unified L2. The cached
+// core reports every instruction fetch and the data accesses each
+// instruction is about to make, interrupt entry its two stack pushes;
+// device registers are not cached. Each instruction costs one cycle
+// plus the latency of the levels behind L1 that its accesses had to go to.
+// Cycles and misses are charged to the symbol the instruction lies in.
+class CacheModel {
+public:
+  CacheModel(const CacheLevel& l1i, const CacheLevel& l1d, const CacheLevel& l2,
+             uint32_t l2Latency, uint32_t memoryLatency, const map<string, uint32_t>& symbols);
+
+  void fetch(uint32_t pc) {
+    function = &functions.at(pc);
+    function->instructions++;
+    function->cycles++;
+    access(l1i, pc, false, function->l1iMisses);
+  }
+
+  void read(uint32_t address, uint32_t size) {data(address, size, false); }
+  void write(uint32_t address, uint32_t size) {data(address, size, true); }
+
+  // Writes the hierarchy and per-symbol statistics to base.txt.
+  void writeReport(const string& base) const;
+
+private:
+  struct Function {
+    uint64_t instructions = 0, cycles = 0;
+    uint64_t l1iMisses = 0, l1dAccesses = 0, l1dMisses = 0, l2Misses = 0;
+  };
+
+  Cache l1i, l1d, l2;
+  uint32_t l2Latency, memoryLatency;
+
+  SymbolRanges<Function> functions;
+  Function* function;
+
+  void data(uint32_t address, uint32_t size, bool write);
+  void access(Cache& l1, uint32_t address, bool write, uint64_t& l1Misses);
+};
+
+#endif //CACHE_HPP
@@ -0,0 +1,59 @@
+#ifndef COST_MODEL_HPP
+#define COST_MODEL_HPP
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <string>
+#include "Instruction.hpp"
+#include "SymbolRanges.hpp"
+using namespace std;
+
+// Simulated timing. Every executed instruction costs the latency of its
+// oc/mod, 1 cycle unless the configuration says otherwise, plus
+//   indirect  for a memory-indirect jump (mod 0x8-0xB) that is taken and
+//             so has to load its target,
+//   pool      for the second load of the pair the assembler emits for a
+//             pool literal, which waits for the address the first loads.
+// The configuration file has one "key cycles" pair per line, the key being
+// the oc/mod byte in hex or one of the names above; # starts a comment.
+class CostModel {
+public:
+  CostModel(const string& configName, const map<string, uint32_t>& symbols);
+
+  // Called by the cached core after ins at address ran and left pc behind.
+  void executed(const DecodedInstruction& ins, uint32_t address, uint32_t pc){
+    uint32_t cycles = latency[ins.op];
+    if(ins.op >= 0x38 && ins.op <= 0x3B && pc != address + 4) cycles += indirect;
+    if(address == poolLoad + 4 && ins.op == 0x92 && ins.regA == poolRegister &&
+       ins.regB == poolRegister && ins.regC == 0 && ins.disp == 0){
+      cycles += pool;
+    }
+    // ld gpr[A] <= mem32[pc + D]
+    if(ins.op == 0x92 && ins.regB == 15 && ins.regC == 0 && ins.regA != 0){
+      poolLoad = address;
+      poolRegister = ins.regA;
+    }
+    Function& function = functions.at(address);
+    function.instructions++;
+    function.cycles += cycles;
+  }
+
+  // Prints total cycles, CPI and the cycles of every symbol that ran.
+  void printReport(ostream& out) const;
+
+private:
+  struct Function {
+    uint64_t instructions = 0, cycles = 0;
+  };
+
+  array<uint32_t, 256> latency;
+  uint32_t indirect = 1, pool = 1;
+  uint32_t poolLoad = UINT32_MAX;
+  uint8_t poolRegister = 0;
+  SymbolRanges<Function> functions;
+
+  void load(const string& configName);
+};
+
+#endif //COST_MODEL_HPP
@@ -0,0 +1,83 @@
+#ifndef DEVICE_HPP
+#define DEVICE_HPP
+
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+#include "IoThread.hpp"
+using namespace std;
+
+// A memory mapped device. Its registers are the aligned words from base to
+// last. Register accesses run on the CPU thread; a device that has to wait
+// for the host submits that work to the I/O thread and finishes in a
+// completion. Setting interrupt asks for an interrupt with the device's
+// cause before the next instruction.
+class Device {
+public:
+  const uint32_t base, last;
+  const int cause;
+  bool interrupt = false;
+
+  Device(uint32_t base, uint32_t last, int cause) : base(base), last(last), cause(cause) {}
+  virtual ~Device() {}
+
+  virtual uint32_t read(uint32_t address) = 0;
+  virtual void write(uint32_t address, uint32_t value) = 0;
+};
+
+// The devices of one core, and the I/O thread they share, started when the
+// first device asks for it. Completions only run in drain(), which the
+// emulator calls where it checks for events, so the run loops never make a
+// system call for a device.
+class DeviceBus {
+public:
+  // The terminal, timer and ipi registers below this are built in.
+  static const uint32_t DEVICE_BASE = 0xFFFFFF30;
+
+  // Devices listed first win when several want an interrupt. Throws if the
+  // registers overlap those of another device.
+  template<typename D>
+  D& attach(D* device){
+    for(auto& other: devices){
+      if(device->base <= other->last && other->base <= device->last){
+        delete device;
+        throw invalid_argument("Device registers overlap");
+      }
+    }
+    devices.emplace_back(device);
+    return *device;
+  }
+
+  Device* find(uint32_t address) const {
+    if(address < DEVICE_BASE || (address & 3) != 0) return nullptr;
+    for(auto& device: devices){
+      if(address >= device->base && address <= device->last) return device.get();
+    }
+    return nullptr;
+  }
+
+  IoThread& io(){
+    if(!thread) thread.reset(new IoThread());
+    return *thread;
+  }
+
+  bool drain() {return thread && thread->pending() && thread->drain(); }
+  // Lets every submitted job finish and runs the completions, for
+  // snapshots and for runs that must not depend on host timing.
+  void settle() {if(thread) thread->settle(); }
+
+  Device* interruptPending() const {
+    for(auto& device: devices){
+      if(device->interrupt) return device.get();
+    }
+    return nullptr;
+  }
+
+private:
+  // the thread stops before the devices it runs jobs for go away
+  vector<unique_ptr<Device>> devices;
+  unique_ptr<IoThread> thread;
+};
+
+#endif //DEVICE_HPP
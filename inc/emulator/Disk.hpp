@@ -0,0 +1,82 @@
+#ifndef DISK_HPP
+#define DISK_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include "Device.hpp"
+#include "Memory.hpp"
+using namespace std;
+
+// Block storage backed by a host file of 512 byte sectors. The guest sets
+// disk_sector (0xFFFFFF40), disk_buffer (0xFFFFFF44) and disk_count
+// (0xFFFFFF48) and writes disk_ctrl (0xFFFFFF4C):
+//   bit 0  start the transfer,
+//   bit 1  write the buffer to the disk instead of reading into it,
+//   bit 2  raise interrupt cause 7 when the transfer is done.
+// Reading disk_ctrl returns the last value written without the start bit.
+// Bit 29 is set while the transfer runs, writes to the disk registers
+// meanwhile do nothing. Bit 31 is set once it completed and bit 30 if it failed:
+// sectors past the end, a read-only file or a host I/O error. disk_size
+// (0xFFFFFF50) is the sector count.
+//
+// The file is read and written on the I/O thread. Reads of whole pages
+// into page aligned buffers from page aligned file offsets map the file
+// privately into guest memory, nothing is copied until the guest writes
+// to the page. A write copies the buffer when it starts, the guest may
+// reuse it right away.
+class Disk : public Device {
+public:
+  static const uint32_t BASE = 0xFFFFFF40, LAST = 0xFFFFFF50;
+  static const uint32_t SECTOR_SIZE = 512;
+  static const uint32_t START = 1, WRITE = 2, IRQ = 4;
+  static const uint32_t BUSY = 0x20000000, ERROR = 0x40000000, DONE = 0x80000000;
+
+  uint32_t sector = 0, buffer = 0, count = 0, control = 0;
+
+  Disk(const string& fileName, Memory& memory, IoThread& io);
+  ~Disk();
+  Disk(const Disk&) = delete;
+  Disk& operator=(const Disk&) = delete;
+
+  uint32_t read(uint32_t address) override;
+  void write(uint32_t address, uint32_t value) override;
+
+private:
+  // Parts of the transfer in flight, filled on the I/O thread and put in
+  // place on the CPU thread once it completed. A run is a mapping of whole
+  // pages, a piece lies within one page and its bytes are in staged.
+  struct Run {
+    uint32_t address;
+    uint64_t offset;
+    uint8_t* image;
+    size_t size;
+  };
+  struct Piece {
+    uint32_t address;
+    size_t start;
+    uint32_t length;
+  };
+
+  Memory& memory;
+  IoThread& io;
+  int fd;
+  bool writable = true;
+  uint32_t sectors;
+  vector<Run> runs;
+  vector<Piece> pieces;
+  vector<uint8_t> staged;
+  // Guest pages a read mapped from the file, by file page, with the data
+  // pointer they got. A write to the file detaches those still using it.
+  multimap<uint64_t, pair<uint32_t, uint8_t*>> mapped;
+
+  void start();
+  void finish(bool ok);
+  bool readFile(uint32_t target, uint64_t offset, uint64_t length);
+  bool writeFile(uint64_t offset);
+  void placeRead();
+  void detach(uint64_t offset, uint64_t length);
+};
+
+#endif //DISK_HPP
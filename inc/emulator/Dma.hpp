@@ -0,0 +1,48 @@
+#ifndef DMA_HPP
+#define DMA_HPP
+
+#include <cstdint>
+#include "Device.hpp"
+#include "Memory.hpp"
+
+// Block transfer device. The guest sets dma_src (0xFFFFFF30), dma_dst
+// (0xFFFFFF34) and dma_len (0xFFFFFF38) and writes dma_ctrl (0xFFFFFF3C):
+//   bit 0  start the transfer,
+//   bit 1  fill dma_len bytes at dma_dst with the low byte of dma_src
+//          instead of copying from dma_src,
+//   bit 2  raise interrupt cause 6 when the transfer is done.
+// The emulator moves CHUNK bytes every INTERVAL instructions, so a large
+// transfer does not stall the store that starts it. Meanwhile dma_len
+// counts the bytes still to go and dma_dst, and dma_src of a copy, move
+// up with them; a copy to an overlapping range above its source works
+// from the end and leaves both in place.
+// Reading dma_ctrl returns the last value written without the start bit.
+// Bit 29 is set while the transfer runs, writes to the dma registers
+// meanwhile do nothing. Bit 31 is set once it completed and bit 30 if it
+// was refused: a range reaching the registers at 0xFFFFFF00.
+class Dma : public Device {
+public:
+  static const uint32_t BASE = 0xFFFFFF30, LAST = 0xFFFFFF3C;
+  static const uint32_t START = 1, FILL = 2, IRQ = 4;
+  static const uint32_t BUSY = 0x20000000, ERROR = 0x40000000, DONE = 0x80000000;
+  static const uint32_t CHUNK = 4096, INTERVAL = 16;
+
+  uint32_t source = 0, destination = 0, length = 0, control = 0;
+
+  Dma(Memory& memory) : Device(BASE, LAST, 6), memory(memory) {}
+
+  uint32_t read(uint32_t address) override;
+  void write(uint32_t address, uint32_t value) override;
+
+  bool busy() const {return control & BUSY; }
+  // Moves the next chunk. Returns whether the transfer has more to move.
+  bool step();
+
+private:
+  Memory& memory;
+
+  void start();
+  void finish(uint32_t status);
+};
+
+#endif //DMA_HPP
@@ -1,30 +1,172 @@
 #ifndef EMULATOR_HPP
 #define EMULATOR_HPP
 
+#include <atomic>
+#include <chrono>
 #include <iostream>
-#include <map>
+#include <memory>
+#include <unordered_set>
+#include "Cache.hpp"
+#include "CostModel.hpp"
+#include "Device.hpp"
+#include "Disk.hpp"
+#include "Dma.hpp"
+#include "Error.hpp"
 #include "Instruction.hpp"
+#include "Jit.hpp"
+#include "Memory.hpp"
+#include "Options.hpp"
+#include "Profiler.hpp"
+#include "Replay.hpp"
+#include "Scheduler.hpp"
 #include "Terminal.hpp"
+#include "Timer.hpp"
+#include "Tracer.hpp"
 using namespace std;
 
-void readFromFile(const std::string& filename, std::map<uint32_t, uint8_t>& memory);
+// Loads a program into memory and its symbol table, if it has one, into
+// symbols.
+void readFromFile(const std::string& filename, Memory& memory, map<string, uint32_t>& symbols);
+
+class GdbStub;
+class Smp;
+
+// Why the run loop ended.
+enum class StopReason {NONE, HALT, INSTRUCTION_LIMIT, TIMEOUT, BREAKPOINT, WATCHPOINT, DEBUGGER};
+
+const char* stopMessage(StopReason reason);
 
 class Emulator{
+  friend struct Handlers;
+  friend class GdbStub;
+  friend class Jit;
+  friend class Smp;
 private:
-  map<uint32_t, uint8_t> memory;
-  int pc = 0x40000000;
-  int GPR[16] = {0};
-  int status = 0, handler =  0, cause = 0;
+  // Owned by core 0, the other cores of an SMP machine share it.
+  unique_ptr<Memory> ownMemory;
+  Memory& memory;
+  // The register file. The pc is r15 and lives in the file, so handlers
+  // reach every register by index. GPR[0] always reads zero: the decoder
+  // points destinations that are r0 at the SINK slot instead.
+  static const int SP = 14, PC = 15, SINK = 16, REGISTERS = 17;
+  int GPR[REGISTERS] = {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x40000000};
+  // Control registers by csr index. The core id is read-only.
+  static const int STATUS = 0, HANDLER = 1, CAUSE = 2, CORE_ID = 3, CSRS = 4;
+  int CSR[CSRS] = {0};
   bool running = true;
+  StopReason stopReason = StopReason::NONE;
+  Fault fault = Fault::NONE;
+  uint64_t instret = 0;
+  // Earliest scheduled event, copied out of the scheduler for the run loops.
+  uint64_t nextEvent = 0;
+  // Instruction counts of the outstanding flush and timer events.
+  uint64_t nextFlush = UINT64_MAX, nextTimer = UINT64_MAX;
+  Scheduler scheduler;
+  DecodedInstruction unaligned;
 
+  Options options;
+  ostream& out;
   Terminal terminal;
-public:
-  Emulator(string inputName){
-    readFromFile(inputName, memory);
+  Timer timer;
+  DeviceBus devices;
+  Dma* dma = nullptr;
+  Disk* disk = nullptr;
+  unique_ptr<Profiler> profiler;
+  unique_ptr<Tracer> tracer;
+  unique_ptr<CacheModel> cache;
+  unique_ptr<CostModel> cost;
+  // Created by the first JIT run and kept, later runs reuse its blocks.
+  unique_ptr<Jit> jit;
+  GdbStub* debugger = nullptr;
+  // Machine this core belongs to with -cores, and its index there.
+  Smp* smp = nullptr;
+  uint32_t coreId = 0;
+  // Set by writes to ipi, taken as interrupt cause 5.
+  atomic<bool> ipiPending{false};
+
+  map<string, uint32_t> symbols;
+  // Breakpoints are looked up only when an instruction is decoded, watched
+  // words only on writes to their hooked pages.
+  unordered_set<uint32_t> breakpoints;
+  struct Watch {
+    uint32_t address;
+    uint32_t value;
+  };
+  vector<Watch> watches;
+  uint32_t watchHit = 0;
+  bool hasDeadline = false;
+  chrono::steady_clock::time_point deadline;
+  // SIGUSR1 count this emulator has answered, every running emulator
+  // takes its own snapshot.
+  unsigned snapshotRequests = 0;
+  // Decoding fuses common instruction sequences into superinstructions,
+  // off when a hooked core has to see every instruction on its own.
+  bool fusion = false;
+
+  // External events are appended while the run is live and fed back from
+  // replayPosition after -replay or a jump back to a checkpoint. Terminal
+  // output of instructions below highWater was written the first time.
+  bool logging = false;
+  vector<ExternalEvent> eventLog;
+  size_t replayPosition = 0;
+  vector<Checkpoint> checkpoints;
+  uint64_t highWater = 0;
+
+  // Hooks compiled into runCached.
+  static const unsigned HOOK_PROFILE = 1, HOOK_TRACE = 2, HOOK_CACHE = 4, HOOK_COST = 8;
+
+  // Another core of the machine boot runs.
+  Emulator(Emulator& boot, uint32_t id);
+
+  void run();
+  void clearStop();
+  template<bool BREAKPOINTS> void runSwitch();
+  template<unsigned HOOKS> void runCached();
+  void runThreaded();
+  void runJit();
+  void fuse(DecodedInstruction& slot, uint32_t address);
+  bool nothingDue();
+  // Called by a superinstruction between its parts. Moves on to the next
+  // part, counting the one just executed, unless the run loop has to look
+  // at events first or the group was overwritten.
+  bool fuseNext(const DecodedInstruction& head){
+    if(head.handler == nullptr) return false;
+    if(instret + 1 >= nextEvent && !nothingDue()) return false;
+    GPR[PC] += 4;
+    instret++;
+    return true;
   }
+  void serviceEvents();
+  void scheduleTimer();
+  void scheduleDma();
+  void installSnapshotSignal();
+  bool takeSnapshotRequest();
+  void saveSnapshot(const string& filename);
+  void restoreSnapshot(const string& filename);
+  void captureState(SnapshotHeader& state) const;
+  void applyState(const SnapshotHeader& state);
+  bool replaying() const {return replayPosition < eventLog.size(); }
+  // Live input and host timer ticks reach the guest only past the log and
+  // past where execution already went, re-execution sees what was logged.
+  bool live() const {return !replaying() && instret >= highWater; }
+  void logExternal(ExternalType type, uint32_t value);
+  void deliverReplayed();
+  void scheduleReplay();
+  void loadEventLog(const string& filename);
+  void saveEventLog(const string& filename) const;
+  void takeCheckpoint();
+  void restoreCheckpoint(size_t index);
+  void runForward(uint64_t target, uint64_t* lastBreak);
+  uint32_t resolve(const string& location) const;
+  void hookedWrite(uint32_t address, uint32_t size);
+public:
+  // Console output and the final processor state go to out.
+  Emulator(string inputName, Options options = Options(), ostream& out = cout);
 
   Instruction readInstruction(uint32_t address);
 
+  const DecodedInstruction& fetch(uint32_t address);
+
   int readWord(uint32_t address);
 
   int readByte(uint32_t address);
@@ -33,21 +175,38 @@ public:
 
   void writeWord(uint32_t address, int value);
 
-  int readGPR(int reg);
+  // Register indexes come from 4-bit fields and cannot be out of range.
+  int readGPR(int reg) {return GPR[reg]; }
 
-  void writeGPR(int reg, int value);
+  void writeGPR(int reg, int value) {GPR[reg != 0 ? reg : SINK] = value; }
 
-  int readCSR(int reg);
+  int readCSR(int reg){
+    if(reg >= CSRS){
+      raiseFault(Fault::INVALID_CSR);
+      return 0;
+    }
+    return CSR[reg];
+  }
 
-  void writeCSR(int reg, int value);
+  void writeCSR(int reg, int value){
+    if(reg >= CORE_ID){
+      raiseFault(Fault::INVALID_CSR);
+      return;
+    }
+    CSR[reg] = value;
+    // unmasking may let a pending interrupt in
+    if(reg == STATUS) nextEvent = 0;
+  }
 
   void pushWord(int value);
+  void cacheAccesses(const DecodedInstruction& ins);
   
   int popWord();
 
   void printMemory();
 
   void printProcessorState();
+  void printRegisters();
 
   void executeInstruction(Instruction ins);
 
@@ -65,10 +224,40 @@ public:
   bool terminalMaksed();
   bool timerMasked();
   void handleInterrupt();
+  void jumpToHandler(int cause);
+  void raiseFault(Fault fault);
+  void enterFault();
 
 
   void start();
 
+  uint64_t instructionCount() const {return instret; }
+  StopReason stopped() const {return stopReason; }
+
+  bool isBreakpoint(uint32_t address) const {return !breakpoints.empty() && breakpoints.count(address) != 0; }
+  void stop(StopReason reason);
+
+  // Debugger control. resume() continues after a stop until the next one,
+  // step() executes a single instruction. Neither does anything once the
+  // guest halted.
+  void resume();
+  void step();
+  void addBreakpoint(uint32_t address);
+  void removeBreakpoint(uint32_t address);
+  void addWatch(uint32_t address);
+  void removeWatch(uint32_t address);
+  // Address of the watched word that caused the last WATCHPOINT stop.
+  uint32_t watchedAddress() const {return watchHit; }
+
+  // Reverse execution, needs -checkpoint. Both restore the closest earlier
+  // checkpoint and re-execute forward from it with logged input.
+  // Returns false if there is no earlier instruction.
+  bool reverseStep();
+  // Goes back to the last breakpoint before the current instruction and
+  // returns true, or goes back to the first checkpoint and returns false.
+  bool reverseContinue();
+  bool canReverse() const {return !checkpoints.empty(); }
+
 
 };
 
@@ -1,52 +1,19 @@
-#include <iostream>
-using namespace std;
+#ifndef EMULATOR_ERROR_HPP
+#define EMULATOR_ERROR_HPP
 
-class DivisionByZero : public exception{
-private:
-  string msg;
-public:
-  DivisionByZero() : msg("Error: Divison by zero"){}
-  const char* what() const throw() override {
-    return msg.c_str();
-  }
-};
-
-class InvalidCSRRegister : public exception{
-private:
-  string msg;
-public:
-  InvalidCSRRegister(int i) : msg("Error: Invalid register csr[" + i + ']'){}
-  const char* what() const throw() override {
-    return msg.c_str();
-  }
-};
+// Guest faults. Handlers record a fault in the emulator and return, the run
+// loop sees it after the instruction and enters the handler with cause 1.
+enum class Fault {NONE, DIVISION_BY_ZERO, INVALID_CSR, STACK_OVERFLOW, INVALID_CODE};
 
-class InvalidGPRRegister : public exception{
-private:
-  string msg;
-public:
-  InvalidGPRRegister(int i) : msg("Error: Invalid register gpr[" + i + ']'){}
-  const char* what() const throw() override {
-    return msg.c_str();
+inline const char* faultMessage(Fault fault){
+  switch (fault)
+  {
+  case Fault::DIVISION_BY_ZERO: return "Error: Divison by zero";
+  case Fault::INVALID_CSR: return "Error: Invalid csr register";
+  case Fault::STACK_OVERFLOW: return "Error: Stack overflow";
+  case Fault::INVALID_CODE: return "Error: Invalid instruction code";
+  default: return "";
   }
-};
+}
 
-class StackOverflow : public exception{
-private:
-  string msg;
-public:
-  StackOverflow() : msg("Error: Stack overflow"){}
-  const char* what() const throw() override {
-    return msg.c_str();
-  }
-};
-
-class InvalidCode : public exception{
-private:
-  string msg;
-public:
-  InvalidCode() : msg("Error: Invalid instruction codeeeeee"){}
-  const char* what() const throw() override {
-    return msg.c_str();
-  }
-};
\ No newline at end of file
+#endif //EMULATOR_ERROR_HPP
@@ -0,0 +1,30 @@
+#ifndef EXECUTABLE_HPP
+#define EXECUTABLE_HPP
+
+#include <cstdint>
+
+// Executable image written by the linker and loaded by the emulator:
+// header, segment table, then the payloads of the segments. A segment is a
+// run of consecutive bytes loaded at address, its payload starts at offset
+// bytes into the file. When a segment covers at least one 4 KiB page
+// completely, offset is padded to the same position inside a page as
+// address, so those pages are whole pages of the file; other payloads
+// follow each other without padding. The symbol table at symbolOffset
+// holds (uint32 value, uint32 name length, name) records.
+const uint32_t EXECUTABLE_MAGIC = 0x3158454D; // "MEX1"
+const uint32_t EXECUTABLE_PAGE_SIZE = 4096;
+
+struct ExecutableHeader {
+  uint32_t magic;
+  uint32_t segmentCount;
+  uint32_t symbolCount;
+  uint32_t symbolOffset;
+};
+
+struct SegmentHeader {
+  uint32_t address;
+  uint32_t size;
+  uint32_t offset;
+};
+
+#endif //EXECUTABLE_HPP
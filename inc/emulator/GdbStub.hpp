@@ -0,0 +1,62 @@
+#ifndef GDB_STUB_HPP
+#define GDB_STUB_HPP
+
+#include <cstdint>
+#include <string>
+using namespace std;
+
+class Emulator;
+
+// GDB remote serial protocol server. Waits for one debugger connection on
+// a localhost TCP port or a Unix socket and runs the emulator on its
+// behalf. The register file is r0..r15 (r15 is pc) followed by status,
+// handler and cause, 32 bits each, little-endian.
+//
+// Software and hardware breakpoints both go into the emulator's breakpoint
+// set, write watchpoints become watched words. Reverse step and continue
+// work when the emulator keeps checkpoints.
+class GdbStub {
+public:
+  static const int REGISTER_COUNT = 19;
+
+  // address is a port number or unix:path.
+  GdbStub(Emulator& emulator, const string& address);
+  GdbStub(const GdbStub&) = delete;
+  GdbStub& operator=(const GdbStub&) = delete;
+  ~GdbStub();
+
+  // Serves the debugger until it kills the target or disconnects. Returns
+  // true if it detached and the guest should keep running.
+  bool serve();
+
+  // Called from the emulator's poll event while the guest runs under
+  // continue: true if the debugger sent an interrupt.
+  bool interruptRequested();
+
+private:
+  Emulator& emulator;
+  int listener = -1, connection = -1;
+  string unixPath;
+  string input;
+  bool noAck = false;
+  bool swbreak = false;
+  bool reverseBegin = false;
+  bool killed = false, detached = false;
+  uint32_t polls = 0;
+
+  bool receive();
+  bool readPacket(string& packet);
+  void sendPacket(const string& data);
+  string handle(const string& packet);
+  string stopReply() const;
+  string readRegisters() const;
+  bool writeRegisters(const string& hex);
+  uint32_t getRegister(int reg) const;
+  void setRegister(int reg, uint32_t value);
+  string readMemory(const string& args) const;
+  bool writeMemory(const string& args);
+  string breakpoint(const string& packet);
+  string resume(const string& action);
+};
+
+#endif //GDB_STUB_HPP
@@ -0,0 +1,283 @@
+#ifndef HANDLERS_HPP
+#define HANDLERS_HPP
+
+#include <array>
+#include "Emulator.hpp"
+
+// One handler per valid oc/mod combination. The decoder picks the handler
+// once, so executing a predecoded instruction is a single indirect call.
+// The bodies live here so the threaded core can inline them. A handler that
+// raises a fault returns without finishing the instruction.
+//
+// Registers are indexed straight into Emulator::GPR. Where an op only writes
+// gpr[A], decode turns r0 into the sink slot, so those handlers are
+// straight-line code; the few that read and write one field go through
+// writeGPR.
+struct Handlers{
+  static const int SP = Emulator::SP, PC = Emulator::PC, SINK = Emulator::SINK;
+
+  // DecodedInstruction::op of undecodable words, and of the instruction a
+  // breakpoint replaces in the decode cache.
+  static const uint8_t OP_INVALID = 0x0F;
+  static const uint8_t OP_BREAKPOINT = 0xFF;
+  // Superinstructions, oc 0xF is not a valid instruction.
+  static const uint8_t OP_PUSH_PUSH = 0xF1;
+  static const uint8_t OP_POP_POP = 0xF2;
+  static const uint8_t OP_IRET = 0xF3;
+  static const uint8_t OP_POP_IRET = 0xF4;
+  static const uint8_t OP_LOAD_LOAD = 0xF5;
+
+  static const array<Handler, 256> table;
+
+  static DecodedInstruction decode(uint32_t code);
+  static DecodedInstruction breakpointInstruction();
+  // Matches the words at the start of code against the sequences below and
+  // turns head, the decoded first word, into the superinstruction. Returns
+  // how many words it covers, 0 if none matched.
+  static uint32_t fuse(const uint32_t* code, uint32_t words, DecodedInstruction& head);
+
+  static void invalid(Emulator& e, const DecodedInstruction&){
+    e.raiseFault(Fault::INVALID_CODE);
+  }
+
+  static void halt(Emulator& e, const DecodedInstruction&){
+    e.running = false;
+  }
+
+  // Stops in front of the instruction, which does not count as executed.
+  static void breakpoint(Emulator& e, const DecodedInstruction&){
+    e.GPR[PC] -= 4;
+    e.instret--;
+    e.stop(StopReason::BREAKPOINT);
+  }
+
+  static void interrupt(Emulator& e, const DecodedInstruction&){
+    e.executeInterruptInstruction();
+  }
+
+  // push pc; pc <= gpr[A] + gpr[B] + D
+  static void call(Emulator& e, const DecodedInstruction& d){
+    e.pushWord(e.GPR[PC]);
+    e.GPR[PC] = e.GPR[d.regA] + e.GPR[d.regB] + d.disp;
+  }
+
+  // push pc; pc <= mem32[gpr[A] + gpr[B] + D]
+  static void callMem(Emulator& e, const DecodedInstruction& d){
+    e.pushWord(e.GPR[PC]);
+    e.GPR[PC] = e.readWord(e.GPR[d.regA] + e.GPR[d.regB] + d.disp);
+  }
+
+  // pc <= gpr[A] + D
+  static void jmp(Emulator& e, const DecodedInstruction& d){
+    e.GPR[PC] = e.GPR[d.regA] + d.disp;
+  }
+
+  // if (gpr[B] == gpr[C]) pc <= gpr[A] + D
+  static void beq(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] == e.GPR[d.regC]){
+      e.GPR[PC] = e.GPR[d.regA] + d.disp;
+    }
+  }
+
+  // if (gpr[B] != gpr[C]) pc <= gpr[A] + D
+  static void bne(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] != e.GPR[d.regC]){
+      e.GPR[PC] = e.GPR[d.regA] + d.disp;
+    }
+  }
+
+  // if (gpr[B] signed> gpr[C]) pc <= gpr[A] + D
+  static void bgt(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] > e.GPR[d.regC]){
+      e.GPR[PC] = e.GPR[d.regA] + d.disp;
+    }
+  }
+
+  // pc <= mem32[gpr[A] + D]
+  static void jmpMem(Emulator& e, const DecodedInstruction& d){
+    e.GPR[PC] = e.readWord(e.GPR[d.regA] + d.disp);
+  }
+
+  // if (gpr[B] == gpr[C]) pc <= mem32[gpr[A] + D]
+  static void beqMem(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] == e.GPR[d.regC]){
+      e.GPR[PC] = e.readWord(e.GPR[d.regA] + d.disp);
+    }
+  }
+
+  // if (gpr[B] != gpr[C]) pc <= mem32[gpr[A] + D]
+  static void bneMem(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] != e.GPR[d.regC]){
+      e.GPR[PC] = e.readWord(e.GPR[d.regA] + d.disp);
+    }
+  }
+
+  // if (gpr[B] signed> gpr[C]) pc <= mem32[gpr[A] + D]
+  static void bgtMem(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regB] > e.GPR[d.regC]){
+      e.GPR[PC] = e.readWord(e.GPR[d.regA] + d.disp);
+    }
+  }
+
+  static void xchg(Emulator& e, const DecodedInstruction& d){
+    int temp = e.GPR[d.regB];
+    e.writeGPR(d.regB, e.GPR[d.regC]);
+    e.writeGPR(d.regC, temp);
+  }
+
+  static void add(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] + e.GPR[d.regC];
+  }
+
+  static void sub(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] - e.GPR[d.regC];
+  }
+
+  static void mul(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] * e.GPR[d.regC];
+  }
+
+  static void div(Emulator& e, const DecodedInstruction& d){
+    if(e.GPR[d.regC] == 0){
+      e.raiseFault(Fault::DIVISION_BY_ZERO);
+      return;
+    }
+    e.GPR[d.regA] = e.GPR[d.regB] / e.GPR[d.regC];
+  }
+
+  static void logicNot(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = ~e.GPR[d.regB];
+  }
+
+  static void logicAnd(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] & e.GPR[d.regC];
+  }
+
+  static void logicOr(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] | e.GPR[d.regC];
+  }
+
+  static void logicXor(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] ^ e.GPR[d.regC];
+  }
+
+  static void shl(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] << e.GPR[d.regC];
+  }
+
+  static void shr(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] >> e.GPR[d.regC];
+  }
+
+  // mem32[gpr[A] + gpr[B] + D] <= gpr[C]
+  static void store(Emulator& e, const DecodedInstruction& d){
+    e.writeWord(e.GPR[d.regA] + e.GPR[d.regB] + d.disp, e.GPR[d.regC]);
+  }
+
+  // gpr[A] <= gpr[A] + D; mem32[gpr[A]] <= gpr[C]
+  static void storePreInc(Emulator& e, const DecodedInstruction& d){
+    e.writeGPR(d.regA, e.GPR[d.regA] + d.disp);
+    e.writeWord(e.GPR[d.regA], e.GPR[d.regC]);
+  }
+
+  // mem32[mem32[gpr[A] + gpr[B] + D]] <= gpr[C]
+  static void storeMem(Emulator& e, const DecodedInstruction& d){
+    uint32_t address = e.readWord(e.GPR[d.regA] + e.GPR[d.regB] + d.disp);
+    e.writeWord(address, e.GPR[d.regC]);
+  }
+
+  // gpr[A] <= csr[B]
+  static void csrToGpr(Emulator& e, const DecodedInstruction& d){
+    int value = e.readCSR(d.regB);
+    if(e.fault != Fault::NONE) return;
+    e.GPR[d.regA] = value;
+  }
+
+  // gpr[A] <= gpr[B] + D
+  static void gprAddDisp(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.GPR[d.regB] + d.disp;
+  }
+
+  // gpr[A] <= mem32[gpr[B] + gpr[C] + D]
+  static void load(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.readWord(e.GPR[d.regB] + e.GPR[d.regC] + d.disp);
+  }
+
+  // gpr[A] <= mem32[gpr[B]]; gpr[B] <= gpr[B] + D
+  static void loadPostInc(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.readWord(e.GPR[d.regB]);
+    e.writeGPR(d.regB, e.GPR[d.regB] + d.disp);
+  }
+
+  // csr[A] <= gpr[B]
+  static void gprToCsr(Emulator& e, const DecodedInstruction& d){
+    e.writeCSR(d.regA, e.GPR[d.regB]);
+  }
+
+  // csr[A] <= csr[B] | D
+  static void csrOrDisp(Emulator& e, const DecodedInstruction& d){
+    int value = e.readCSR(d.regB);
+    if(e.fault != Fault::NONE) return;
+    e.writeCSR(d.regA, value | d.disp);
+  }
+
+  // csr[A] <= mem32[gpr[B] + gpr[C] + D]
+  static void loadCsr(Emulator& e, const DecodedInstruction& d){
+    e.writeCSR(d.regA, e.readWord(e.GPR[d.regB] + e.GPR[d.regC] + d.disp));
+  }
+
+  // csr[A] <= mem32[gpr[B]]; gpr[B] <= gpr[B] + D
+  static void loadCsrPostInc(Emulator& e, const DecodedInstruction& d){
+    e.writeCSR(d.regA, e.readWord(e.GPR[d.regB]));
+    if(e.fault != Fault::NONE) return;
+    e.writeGPR(d.regB, e.GPR[d.regB] + d.disp);
+  }
+
+  // Superinstructions for what the assembler emits for push, pop, iret and
+  // loads through the literal pool, see Handlers::fuse. Their operands are
+  // fixed, so sp is used directly. Each word still counts as one
+  // instruction and events are serviced between them when due.
+
+  // push gpr[C]; push gpr[B]
+  static void pushPush(Emulator& e, const DecodedInstruction& d){
+    e.GPR[SP] -= 4;
+    e.writeWord(e.GPR[SP], e.GPR[d.regC]);
+    if(!e.fuseNext(d)) return;
+    e.GPR[SP] -= 4;
+    e.writeWord(e.GPR[SP], e.GPR[d.regB]);
+  }
+
+  // pop gpr[A]; pop gpr[B]
+  static void popPop(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.readWord(e.GPR[SP]);
+    e.GPR[SP] += 4;
+    if(!e.fuseNext(d)) return;
+    e.GPR[d.regB] = e.readWord(e.GPR[SP]);
+    e.GPR[SP] += 4;
+  }
+
+  // status <= mem32[sp + 4]; pc <= mem32[sp]; sp <= sp + 8
+  static void iret(Emulator& e, const DecodedInstruction& d){
+    e.writeCSR(Emulator::STATUS, e.readWord(e.GPR[SP] + 4));
+    if(!e.fuseNext(d)) return;
+    e.GPR[PC] = e.readWord(e.GPR[SP]);
+    e.GPR[SP] += 8;
+  }
+
+  // pop gpr[A]; iret
+  static void popIret(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.readWord(e.GPR[SP]);
+    e.GPR[SP] += 4;
+    if(!e.fuseNext(d)) return;
+    iret(e, d);
+  }
+
+  // gpr[A] <= mem32[pc + D]; gpr[A] <= mem32[gpr[A]]
+  static void loadLoad(Emulator& e, const DecodedInstruction& d){
+    e.GPR[d.regA] = e.readWord(e.GPR[PC] + d.disp);
+    if(!e.fuseNext(d)) return;
+    e.GPR[d.regA] = e.readWord(e.GPR[d.regA]);
+  }
+};
+
+#endif //HANDLERS_HPP
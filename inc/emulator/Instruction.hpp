@@ -9,6 +9,7 @@ struct Instruction{
 private:
   uint32_t code;
 public:
+  Instruction(uint32_t code) : code(code) {}
   Instruction(int byte1, int byte2, int byte3, int byte4){
     code = (byte4 << 24) ^ (byte3 << 16) ^ (byte2 << 8) ^ byte1;
   }
@@ -31,4 +32,21 @@ public:
   }
 };
 
+class Emulator;
+struct DecodedInstruction;
+
+typedef void (*Handler)(Emulator&, const DecodedInstruction&);
+
+// Instruction with its fields already extracted and its oc/mod combination
+// resolved to the handler that executes it. A null handler marks a slot that
+// still has to be decoded. op is the raw oc/mod byte, used by the threaded
+// core to index its label table. regA may be Emulator::SINK, see
+// Handlers.hpp.
+struct DecodedInstruction{
+  Handler handler = nullptr;
+  uint8_t op = 0;
+  uint8_t regA = 0, regB = 0, regC = 0;
+  int disp = 0;
+};
+
 #endif //INSTRUCTION_HPP
\ No newline at end of file
@@ -0,0 +1,85 @@
+#ifndef IO_THREAD_HPP
+#define IO_THREAD_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Completions handed from the I/O thread to the CPU thread. A ring with a
+// single producer and a single consumer, the two indexes are the only
+// shared state, so neither side ever takes a lock.
+class CompletionQueue {
+public:
+  static const size_t CAPACITY = 1024;
+
+  // I/O thread. Returns false if the ring is full.
+  bool push(function<void()>& completion);
+  // CPU thread. Returns false if the ring is empty.
+  bool pop(function<void()>& completion);
+  bool empty() const {return head.load(memory_order_acquire) == tail.load(memory_order_acquire); }
+
+private:
+  function<void()> slots[CAPACITY];
+  // next slot to pop and next slot to push
+  atomic<size_t> head{0}, tail{0};
+};
+
+// Host thread that does the blocking I/O of the devices. Jobs run in the
+// order they were submitted. Whatever a job wants the CPU to see it posts
+// as a completion, which runs on the CPU thread the next time the
+// emulator checks for events. Watched file descriptors are read whenever
+// they have data.
+class IoThread {
+public:
+  IoThread();
+  IoThread(const IoThread&) = delete;
+  IoThread& operator=(const IoThread&) = delete;
+  // Finishes the submitted jobs, then stops.
+  ~IoThread();
+
+  // CPU thread: queues job for the I/O thread.
+  void submit(function<void()> job);
+  // CPU thread: reads fd until end of file or an error and passes what it
+  // read to received as a completion. fd must be non-blocking.
+  void watch(int fd, function<void(const string&)> received);
+  // I/O thread: queues completion for the CPU thread, waits while the
+  // queue is full unless the thread is stopping.
+  void post(function<void()> completion);
+
+  // CPU thread: runs the posted completions. Returns true if there were
+  // any.
+  bool drain();
+  bool pending() const {return !completions.empty(); }
+  // CPU thread: waits until every submitted job has run and drains.
+  void settle();
+
+private:
+  struct Watch {
+    int fd;
+    function<void(const string&)> received;
+  };
+
+  thread worker;
+  mutex lock;
+  condition_variable idle;
+  deque<function<void()>> jobs;
+  // shared with the completions that carry their data
+  vector<shared_ptr<Watch>> watches;
+  bool busy = false;
+  atomic<bool> stopping{false};
+  // written to wake the worker out of poll()
+  int wake[2];
+  CompletionQueue completions;
+
+  void work();
+  bool readWatched(const shared_ptr<Watch>& watch);
+};
+
+#endif //IO_THREAD_HPP
@@ -0,0 +1,84 @@
+#ifndef JIT_HPP
+#define JIT_HPP
+
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+using namespace std;
+
+class Emulator;
+
+// Basic-block translator from guest code to x86-64.
+//
+// A block is a run of straight-line guest instructions that ends with a
+// jmp/branch/call/ret, before an instruction the JIT leaves to the
+// interpreter (int, halt, csr access, ...), at a page boundary or after
+// BLOCK_LIMIT instructions. Guest registers stay in Emulator::GPR, memory
+// accesses call back into Memory and exit to the interpreter when they hit
+// the MMIO range. Exits with a known target are patched into direct jumps to
+// the next block once it is compiled. Writes to a page holding compiled code
+// throw away the blocks that cover the written bytes.
+class Jit {
+public:
+  static const uint32_t BLOCK_LIMIT = 64;
+  static const size_t CACHE_SIZE = 16 << 20;
+
+  // Shared with generated code, field offsets are hardcoded in Jit.cpp.
+  struct Context {
+    int32_t budget;
+    uint32_t nextPc;
+    uint8_t* lastExit;
+  };
+
+  Jit(Emulator& emulator);
+  Jit(const Jit&) = delete;
+  Jit& operator=(const Jit&) = delete;
+  ~Jit();
+
+  bool available() const {return buffer != nullptr; }
+
+  // Runs compiled code starting at pc for at most budget guest instructions
+  // and returns how many were executed. Returns 0 without touching pc when
+  // there is no block for pc or it does not fit into the budget; the caller
+  // then has to interpret one instruction.
+  uint32_t run(int& pc, int32_t budget);
+
+  // Called by the emulator for writes to pages that hold compiled code.
+  void codeWritten(uint32_t address, uint32_t size);
+
+private:
+  struct Block {
+    uint32_t start, end;
+    uint32_t length;
+    uint8_t* entry;
+    bool live = true;
+    vector<uint8_t*> incoming;
+  };
+
+  Emulator& emulator;
+  uint8_t* buffer = nullptr;
+  size_t used = 0, codeStart = 0;
+  uint8_t* exitStub = nullptr;
+  void (*enter)(int* gpr, Context* context, Jit* jit, uint8_t* code) = nullptr;
+
+  Context context;
+  bool invalidated = false;
+  uint32_t flushes = 0;
+
+  vector<unique_ptr<Block>> allBlocks;
+  unordered_map<uint32_t, Block*> blocks;
+  unordered_map<uint32_t, vector<Block*>> pageBlocks;
+
+  void flush();
+  Block* lookup(uint32_t pc);
+  Block* compile(uint32_t pc);
+  void chain(uint8_t* site, Block* target);
+  void unchain(uint8_t* site, uint32_t target);
+  void kill(Block* block);
+
+  static uint32_t loadHelper(Jit* jit, uint32_t address);
+  static uint32_t storeHelper(Jit* jit, uint32_t address, uint32_t value);
+};
+
+#endif //JIT_HPP
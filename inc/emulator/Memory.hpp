@@ -0,0 +1,207 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "Instruction.hpp"
+
+// Guest memory is a sparse two-level page table. The top 10 address bits
+// select a table, the next 10 bits select a 4 KiB page inside it. Tables and
+// pages are allocated on first write, reads of untouched memory return zero.
+// Pages loaded from an executable point into a private file mapping, so the
+// kernel copies them only when the guest writes to them.
+//
+// The cores of an SMP machine share one Memory. Aligned word accesses are
+// single atomic loads and stores, so no core ever sees a torn word, and
+// with shared set they are sequentially consistent as well, which is what
+// guest mutual exclusion like Peterson's algorithm relies on. Byte and
+// unaligned word accesses carry no such guarantee.
+
+const uint32_t PAGE_BITS = 12;
+const uint32_t PAGE_SIZE = 1 << PAGE_BITS;
+const uint32_t PAGE_MASK = PAGE_SIZE - 1;
+const uint32_t TABLE_BITS = 10;
+const uint32_t TABLE_SIZE = 1 << TABLE_BITS;
+// Most words a superinstruction covers.
+const uint32_t FUSE_LIMIT = 3;
+
+// Instructions decoded from a page, one slot per aligned word. Writing to the
+// page clears the slots of the words it touched so they get decoded again.
+struct DecodedPage {
+  DecodedInstruction slots[PAGE_SIZE / 4];
+};
+
+struct Page {
+  uint8_t* data = nullptr;
+  DecodedPage* decoded = nullptr;
+  // Writes to this page are reported to Memory::writeHook.
+  bool hooked = false;
+  bool mapped = false;
+  // Written since the last clearDirty() or checkpoint. Checkpoints move
+  // dirty to checkpointed, snapshots save pages with either set.
+  bool dirty = false;
+  bool checkpointed = false;
+
+  // Allocated on first use. Cores that race for it keep the first copy.
+  DecodedPage& decodedPage() {
+    DecodedPage* current = __atomic_load_n(&decoded, __ATOMIC_ACQUIRE);
+    if(current != nullptr) return *current;
+    DecodedPage* fresh = new DecodedPage();
+    if(__atomic_compare_exchange_n(&decoded, &current, fresh, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return *fresh;
+    delete fresh;
+    return *current;
+  }
+
+  // The two slots in front of the written words are cleared as well, they
+  // may hold a superinstruction that covers them.
+  // Other cores may be fetching from the slots, handlers are atomic.
+  void invalidate(uint32_t offset, uint32_t size) {
+    DecodedPage* current = __atomic_load_n(&decoded, __ATOMIC_ACQUIRE);
+    if(current == nullptr) return;
+    uint32_t first = offset >> 2;
+    first = first < FUSE_LIMIT - 1 ? 0 : first - (FUSE_LIMIT - 1);
+    for(uint32_t slot = first; slot <= (offset + size - 1) >> 2; slot++){
+      __atomic_store_n(&current->slots[slot].handler, nullptr, __ATOMIC_RELEASE);
+    }
+  }
+};
+
+class Memory {
+private:
+  Page* tables[TABLE_SIZE] = {nullptr};
+  // mmap()ed regions by base, with the number of pages using them.
+  struct Mapping {
+    size_t size;
+    size_t pages;
+  };
+  map<uint8_t*, Mapping> mappings;
+  // Page data replaced while other cores may still be reading it, freed
+  // with the memory.
+  vector<uint8_t*> retired;
+  mutex allocation;
+
+  static uint32_t tableIndex(uint32_t address) {return address >> (PAGE_BITS + TABLE_BITS); }
+  static uint32_t pageIndex(uint32_t address) {return (address >> PAGE_BITS) & (TABLE_SIZE - 1); }
+
+  uint32_t readWordSlow(uint32_t address) const;
+  void writeWordSlow(uint32_t address, uint32_t value);
+  Page& allocatePage(uint32_t address);
+  map<uint8_t*, Mapping>::iterator findMapping(uint8_t* data);
+  void release(uint8_t* data);
+
+public:
+  // Called for writes to hooked pages: pages the JIT compiled code from and
+  // pages holding watched words.
+  function<void(uint32_t address, uint32_t size)> writeHook;
+  // Set while more than one core runs on this memory.
+  bool shared = false;
+
+  Memory() {}
+  Memory(const Memory&) = delete;
+  Memory& operator=(const Memory&) = delete;
+  ~Memory();
+
+  // Returns the page holding address, or nullptr if it was never written.
+  Page* findPage(uint32_t address) const {
+    Page* table = __atomic_load_n(&tables[tableIndex(address)], __ATOMIC_ACQUIRE);
+    if(table == nullptr) return nullptr;
+    Page* page = &table[pageIndex(address)];
+    return __atomic_load_n(&page->data, __ATOMIC_ACQUIRE) != nullptr ? page : nullptr;
+  }
+
+  // Returns the page holding address, allocating it if needed.
+  Page& getPage(uint32_t address) {
+    Page* page = findPage(address);
+    return page != nullptr ? *page : allocatePage(address);
+  }
+
+  uint8_t readByte(uint32_t address) const {
+    Page* page = findPage(address);
+    return page != nullptr ? page->data[address & PAGE_MASK] : 0;
+  }
+
+  void writeByte(uint32_t address, uint8_t value) {
+    Page& page = getPage(address);
+    page.data[address & PAGE_MASK] = value;
+    page.dirty = true;
+    page.invalidate(address & PAGE_MASK, 1);
+    if(page.hooked) writeHook(address, 1);
+  }
+
+  // Words are little-endian. Accesses that stay inside one page are a single
+  // load or store, words that straddle two pages go byte by byte.
+  uint32_t readWord(uint32_t address) const {
+    if((address & PAGE_MASK) > PAGE_SIZE - 4) return readWordSlow(address);
+    Page* page = findPage(address);
+    if(page == nullptr) return 0;
+    uint8_t* data = page->data + (address & PAGE_MASK);
+    if(address & 3){
+      uint32_t value;
+      memcpy(&value, data, sizeof(value));
+      return value;
+    }
+    if(shared) return __atomic_load_n(reinterpret_cast<uint32_t*>(data), __ATOMIC_SEQ_CST);
+    return __atomic_load_n(reinterpret_cast<uint32_t*>(data), __ATOMIC_RELAXED);
+  }
+
+  void writeWord(uint32_t address, uint32_t value) {
+    if((address & PAGE_MASK) > PAGE_SIZE - 4) return writeWordSlow(address, value);
+    Page& page = getPage(address);
+    uint8_t* data = page.data + (address & PAGE_MASK);
+    if(address & 3) memcpy(data, &value, sizeof(value));
+    else if(shared) __atomic_store_n(reinterpret_cast<uint32_t*>(data), value, __ATOMIC_SEQ_CST);
+    else __atomic_store_n(reinterpret_cast<uint32_t*>(data), value, __ATOMIC_RELAXED);
+    page.dirty = true;
+    page.invalidate(address & PAGE_MASK, 4);
+    if(page.hooked) writeHook(address, 4);
+  }
+
+  // Makes the page holding address use data, which lies in a region passed
+  // to addMapping.
+  void mapPage(uint32_t address, uint8_t* data);
+
+  // Gives a page mapped from a file a private copy of its contents.
+  void detachPage(uint32_t address);
+
+  // For devices that store to page data directly: marks the page dirty,
+  // drops the decoded words and reports the write to writeHook.
+  void written(Page& page, uint32_t address, uint32_t size);
+
+  void clearDirty();
+
+  // Bulk transfers for devices, page by page with memmove/memset. copy
+  // behaves like memmove for overlapping ranges. Untouched pages read as
+  // zero, so zeros written to them allocate nothing. Unlike writeWord these
+  // are not atomic per word when the memory is shared.
+  void copy(uint32_t destination, uint32_t source, uint32_t length);
+  void fill(uint32_t destination, uint8_t value, uint32_t length);
+
+  // Takes ownership of an mmap()ed region. It is unmapped once the pages
+  // mapped into it were all replaced or detached, or with the memory.
+  void addMapping(void* base, size_t size) {
+    lock_guard<mutex> lock(allocation);
+    mappings[static_cast<uint8_t*>(base)] = {size, 0};
+  }
+
+  // Unmaps a region passed to addMapping if no page was mapped into it.
+  void dropMapping(void* base);
+
+  // Calls f(baseAddress, page) for every allocated page in address order.
+  template<typename F>
+  void forEachPage(F f) const {
+    for(uint32_t t = 0; t < TABLE_SIZE; t++){
+      if(tables[t] == nullptr) continue;
+      for(uint32_t p = 0; p < TABLE_SIZE; p++){
+        if(tables[t][p].data == nullptr) continue;
+        f((t << (PAGE_BITS + TABLE_BITS)) | (p << PAGE_BITS), tables[t][p]);
+      }
+    }
+  }
+};
+
+#endif //MEMORY_HPP
@@ -0,0 +1,182 @@
+#ifndef OPTIONS_HPP
+#define OPTIONS_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "Cache.hpp"
+using namespace std;
+
+enum class Core {SWITCH, CACHED, THREADED, JIT};
+enum class TimerClock {HOST, INSTRET};
+
+struct Options{
+  Core core = Core::CACHED;
+  // Guest instructions between two polls of stdin.
+  uint32_t pollInterval = 1024;
+  // Console output is buffered and written out at the latest this many
+  // guest instructions after the first pending byte.
+  bool bufferedOutput = true;
+  uint32_t flushInterval = 100000;
+  // The timer counts host milliseconds, or guest instructions at a fixed
+  // rate per millisecond for reproducible runs.
+  TimerClock timerClock = TimerClock::HOST;
+  uint32_t timerRate = 1000;
+  // Profiling runs on the cached core and writes profileName.txt and
+  // profileName.folded at halt.
+  bool profile = false;
+  string profileName = "profile";
+  // Tracing also runs on the cached core and records every instruction to
+  // traceName, see TraceFormat.hpp.
+  string traceName;
+  // So does the cache simulation, which writes cacheName.txt at halt. L2
+  // and memory latencies are in cycles.
+  bool cache = false;
+  string cacheName = "cache";
+  CacheLevel l1i = {32 << 10, 8, 64};
+  CacheLevel l1d = {32 << 10, 8, 64};
+  CacheLevel l2 = {256 << 10, 8, 64};
+  uint32_t l2Latency = 12, memoryLatency = 100;
+  // The cost model too, its latencies come from costName if given, see
+  // CostModel.hpp.
+  bool cost = false;
+  string costName;
+  // Snapshots go to snapshotName, at instruction snapshotAt and whenever
+  // the emulator gets SIGUSR1; batch jobs prefix it with their program. A
+  // run can start from restoreName instead of the program entry, the
+  // instruction limit and snapshotAt then come from this run's options.
+  string snapshotName = "snapshot.bin";
+  uint64_t snapshotAt = UINT64_MAX;
+  string restoreName;
+  // Terminal input and host timer ticks are logged to recordName and can
+  // be fed back from replayName. With checkpointInterval set the emulator
+  // keeps a checkpoint every that many instructions for reverse execution.
+  string recordName;
+  string replayName;
+  uint64_t checkpointInterval = 0;
+  // Headless runs leave the tty alone and feed the terminal from input.
+  // Batch mode runs every program given headless on jobs threads (0 means
+  // one per host CPU).
+  bool headless = false;
+  string input;
+  bool batch = false;
+  unsigned jobs = 0;
+  // Benchmark mode times every program given, see Bench.hpp. Tolerance is
+  // in percent of the baseline MIPS.
+  bool bench = false;
+  unsigned benchRuns = 3;
+  string baseline;
+  double benchTolerance = 5;
+  // Stop conditions. Breakpoints and watched words are addresses or symbol
+  // names, timeout is in milliseconds of host time (0 for none).
+  uint64_t maxInstret = UINT64_MAX;
+  uint32_t timeout = 0;
+  vector<string> breakpoints;
+  vector<string> watchpoints;
+  // With gdb set the emulator waits for a GDB remote protocol connection on
+  // that localhost TCP port, or on the Unix socket given as unix:path, and
+  // runs under the debugger's control.
+  string gdb;
+  // Host file behind the block storage device, see Disk.hpp.
+  string disk;
+  // Number of guest cores, see Smp.hpp.
+  uint32_t cores = 1;
+
+  // Applies a single "-name=value" command line option.
+  void processArgument(string arg){
+    if(arg == "-core=switch") core = Core::SWITCH;
+    else if(arg == "-core=cached") core = Core::CACHED;
+    else if(arg == "-core=threaded") core = Core::THREADED;
+    else if(arg == "-core=jit") core = Core::JIT;
+    else if(arg.substr(0, 6) == "-poll=") pollInterval = max(1ul, stoul(arg.substr(6)));
+    else if(arg.substr(0, 7) == "-flush=") flushInterval = max(1ul, stoul(arg.substr(7)));
+    else if(arg == "-unbuffered") bufferedOutput = false;
+    else if(arg == "-timer=host") timerClock = TimerClock::HOST;
+    else if(arg == "-timer=instret") timerClock = TimerClock::INSTRET;
+    else if(arg.substr(0, 12) == "-timer-rate=") timerRate = max(1ul, stoul(arg.substr(12)));
+    else if(arg == "-profile") profile = true;
+    else if(arg.substr(0, 9) == "-profile="){
+      profile = true;
+      profileName = arg.substr(9);
+    }
+    else if(arg.substr(0, 7) == "-trace=") traceName = arg.substr(7);
+    else if(arg == "-cache") cache = true;
+    else if(arg == "-cost") cost = true;
+    else if(arg.substr(0, 6) == "-cost="){
+      cost = true;
+      costName = arg.substr(6);
+    }
+    else if(arg.substr(0, 7) == "-cache="){
+      cache = true;
+      cacheName = arg.substr(7);
+    }
+    else if(arg.substr(0, 11) == "-cache-l1i="){
+      cache = true;
+      l1i = CacheLevel::parse(arg.substr(11));
+    }
+    else if(arg.substr(0, 11) == "-cache-l1d="){
+      cache = true;
+      l1d = CacheLevel::parse(arg.substr(11));
+    }
+    else if(arg.substr(0, 10) == "-cache-l2="){
+      cache = true;
+      l2 = CacheLevel::parse(arg.substr(10));
+    }
+    else if(arg.substr(0, 15) == "-cache-latency="){
+      cache = true;
+      size_t colon = arg.find(':', 15);
+      if(colon == string::npos) throw invalid_argument("-cache-latency must be l2:memory");
+      l2Latency = stoul(arg.substr(15, colon - 15));
+      memoryLatency = stoul(arg.substr(colon + 1));
+    }
+    else if(arg.substr(0, 10) == "-snapshot=") snapshotName = arg.substr(10);
+    else if(arg.substr(0, 13) == "-snapshot-at=") snapshotAt = stoull(arg.substr(13));
+    else if(arg.substr(0, 9) == "-restore=") restoreName = arg.substr(9);
+    else if(arg.substr(0, 8) == "-record=") recordName = arg.substr(8);
+    else if(arg.substr(0, 8) == "-replay=") replayName = arg.substr(8);
+    else if(arg.substr(0, 12) == "-checkpoint=") checkpointInterval = stoull(arg.substr(12));
+    else if(arg == "-headless") headless = true;
+    else if(arg.substr(0, 7) == "-input="){
+      headless = true;
+      input = arg.substr(7);
+    }
+    else if(arg.substr(0, 12) == "-input-file="){
+      ifstream inFile(arg.substr(12), ios::binary);
+      if(!inFile) throw invalid_argument("Failed to open input file " + arg.substr(12));
+      stringstream content;
+      content << inFile.rdbuf();
+      headless = true;
+      input = content.str();
+    }
+    else if(arg == "-batch"){
+      batch = true;
+      headless = true;
+    }
+    else if(arg.substr(0, 6) == "-jobs=") jobs = stoul(arg.substr(6));
+    else if(arg == "-bench"){
+      bench = true;
+      headless = true;
+    }
+    else if(arg.substr(0, 12) == "-bench-runs=") benchRuns = max(1ul, stoul(arg.substr(12)));
+    else if(arg.substr(0, 17) == "-bench-tolerance=") benchTolerance = stod(arg.substr(17));
+    else if(arg.substr(0, 10) == "-baseline="){
+      bench = true;
+      headless = true;
+      baseline = arg.substr(10);
+    }
+    else if(arg.substr(0, 13) == "-max-instret=") maxInstret = stoull(arg.substr(13));
+    else if(arg.substr(0, 9) == "-timeout=") timeout = stoul(arg.substr(9));
+    else if(arg.substr(0, 7) == "-break=") breakpoints.push_back(arg.substr(7));
+    else if(arg.substr(0, 7) == "-watch=") watchpoints.push_back(arg.substr(7));
+    else if(arg.substr(0, 5) == "-gdb=") gdb = arg.substr(5);
+    else if(arg.substr(0, 6) == "-disk=") disk = arg.substr(6);
+    else if(arg.substr(0, 7) == "-cores=") cores = max(1ul, stoul(arg.substr(7)));
+    else throw invalid_argument("Unknown option " + arg);
+  }
+};
+
+#endif //OPTIONS_HPP
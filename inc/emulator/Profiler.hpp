@@ -0,0 +1,93 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "Instruction.hpp"
+#include "SymbolRanges.hpp"
+using namespace std;
+
+class Emulator;
+
+// Guest execution profile. The cached core calls instruction() before and
+// executed() after every instruction when it is instantiated with profiling
+// on; the emulator reports interrupts and terminal accesses from its slow
+// paths. Call stacks follow call instructions and pops into pc, interrupts
+// open a frame of their own. Frames and addresses in the report are named
+// after the symbol that covers them.
+class Profiler {
+public:
+  static const uint32_t MAX_DEPTH = 1024;
+
+  Profiler(uint32_t entry, const map<string, uint32_t>& symbols);
+
+  void instruction(uint32_t pc) {
+    if(pc != fallthrough) blockEntries[pc]++;
+    fallthrough = pc + 4;
+    current = pc;
+    pcCount(pc)++;
+    nodes[stack.back().node].count++;
+  }
+
+  void executed(Emulator& e, const DecodedInstruction& ins, uint32_t pc);
+  void interrupt(int cause, uint32_t returnPc, uint32_t handler);
+  void terminalOutput() {terminalWrites++; }
+  void terminalInput() {terminalReads++; }
+
+  // Writes the hot-spot report to base.txt and the collapsed stacks to
+  // base.folded.
+  void writeReport(const string& base, uint64_t instret) const;
+
+private:
+  struct PageCounts {
+    uint64_t counts[1024] = {0};
+  };
+  // One node per distinct call path, children are looked up by parent,
+  // callee and whether the frame is an interrupt.
+  struct Node {
+    uint32_t parent;
+    string name;
+    uint64_t count;
+  };
+  struct Frame {
+    uint32_t returnAddress;
+    uint32_t node;
+  };
+
+  uint64_t ops[256] = {0};
+  uint64_t reads = 0, writes = 0;
+  uint64_t interrupts[8] = {0};
+  uint64_t terminalWrites = 0, terminalReads = 0;
+
+  uint32_t fallthrough = 0, current = 0;
+  unordered_map<uint32_t, uint64_t> blockEntries;
+  unordered_map<uint32_t, unique_ptr<PageCounts>> pages;
+  uint32_t lastPage = 1;
+  PageCounts* last = nullptr;
+
+  vector<Node> nodes;
+  unordered_map<uint64_t, uint32_t> children;
+  vector<Frame> stack;
+  // Only names addresses, lookups just move its cached range.
+  mutable SymbolRanges<char> functions;
+
+  uint64_t& pcCount(uint32_t pc) {
+    if((pc & ~0xFFFu) != lastPage){
+      lastPage = pc & ~0xFFFu;
+      unique_ptr<PageCounts>& page = pages[lastPage];
+      if(!page) page.reset(new PageCounts());
+      last = page.get();
+    }
+    return last->counts[(pc & 0xFFF) >> 2];
+  }
+
+  void push(uint32_t function, uint32_t returnAddress, int cause);
+  string path(uint32_t node) const;
+  string label(uint32_t address) const;
+};
+
+#endif //PROFILER_HPP
@@ -0,0 +1,46 @@
+#ifndef REPLAY_HPP
+#define REPLAY_HPP
+
+#include <cstdint>
+#include <map>
+#include <vector>
+#include "Memory.hpp"
+#include "Scheduler.hpp"
+#include "Snapshot.hpp"
+using namespace std;
+
+// Event log file: header, then one ExternalEvent per input byte or host
+// timer tick the guest saw, in delivery order. Everything else the guest
+// observes follows from the program and the instruction count, so a run
+// replayed from the log is the same run.
+const uint32_t EVENT_LOG_MAGIC = 0x314C5645; // "EVL1"
+
+enum class ExternalType : uint32_t {INPUT, TIMER};
+
+struct EventLogHeader {
+  uint32_t magic;
+  // timer settings of the recorded run, replay uses them too
+  uint32_t timerClock;
+  uint32_t timerRate;
+  uint32_t reserved;
+  uint64_t eventCount;
+};
+
+// Delivered at the end of the serviceEvents call at instret.
+struct ExternalEvent {
+  uint64_t instret;
+  uint32_t type;
+  uint32_t value;
+};
+
+// In-memory checkpoint for reverse execution. Holds the processor and
+// device state and the pages written since the previous checkpoint, the
+// first checkpoint holds every page.
+struct Checkpoint {
+  SnapshotHeader state;
+  vector<Scheduler::Event> events;
+  size_t logPosition;
+  map<uint32_t, vector<uint8_t>> pages;
+};
+
+#endif //REPLAY_HPP
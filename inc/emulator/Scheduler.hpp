@@ -0,0 +1,46 @@
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <cstdint>
+#include <queue>
+#include <vector>
+using namespace std;
+
+enum class EventType {POLL, FLUSH, TIMER, SNAPSHOT, LIMIT, REPLAY, CHECKPOINT, DMA};
+
+// Pending device events ordered by the instruction count they are due at.
+// The run loops only compare instret against the earliest one.
+class Scheduler {
+public:
+  struct Event {
+    uint64_t when;
+    EventType type;
+
+    bool operator>(const Event& other) const {return when > other.when; }
+  };
+
+  void schedule(uint64_t when, EventType type) {queue.push({when, type}); }
+
+  // Instruction count of the earliest pending event.
+  uint64_t next() const {return queue.empty() ? UINT64_MAX : queue.top().when; }
+
+  // Takes the earliest event off the queue if it is due at instret.
+  bool pop(uint64_t instret, Event& event) {
+    if(queue.empty() || queue.top().when > instret) return false;
+    event = queue.top();
+    queue.pop();
+    return true;
+  }
+
+  // All pending events in due order.
+  vector<Event> pending() const {
+    vector<Event> events;
+    for(auto copy = queue; !copy.empty(); copy.pop()) events.push_back(copy.top());
+    return events;
+  }
+
+private:
+  priority_queue<Event, vector<Event>, greater<Event>> queue;
+};
+
+#endif //SCHEDULER_HPP
@@ -0,0 +1,61 @@
+#ifndef SMP_HPP
+#define SMP_HPP
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+class Emulator;
+
+// Multi-core machine for -cores=N. Core 0 is the emulator that loaded the
+// program; cores 1..N-1 share its memory and run on host threads of their
+// own, each with its own registers, CSRs and event schedule. All cores start
+// at the entry point and tell each other apart by the core id in csr 3.
+//
+// The terminal and the timer stay with core 0: only core 0 takes their
+// interrupts and programs the timer, other cores read tim_cfg as 0 and their
+// writes to it are ignored. Every core can use term_out and term_in,
+// accesses are serialized and the output goes out at core 0's polls.
+// A write to ipi (0xFFFFFF20) raises an inter-processor interrupt, cause 5,
+// on every core whose bit is set; reading it returns the mask of existing
+// cores. Other cores see the interrupt at their next poll.
+//
+// Every core has a DMA engine of its own at the same registers, like a
+// core-local device: a core sees only its own dma_* registers, and the
+// completion interrupt goes to the core that started the transfer. The
+// disk is not available with more than one core.
+//
+// The machine stops when core 0 halts or stops, the other cores are stopped
+// at their next poll.
+class Smp {
+public:
+  static const uint32_t MAX_CORES = 32;
+
+  Smp(Emulator& boot);
+  Smp(const Smp&) = delete;
+  Smp& operator=(const Smp&) = delete;
+  ~Smp();
+
+  void run();
+  void printState();
+
+  uint32_t coreMask() const {return (uint32_t) ((1ull << (cores.size() + 1)) - 1); }
+  void interrupt(uint32_t mask);
+  uint32_t terminalRead();
+  void terminalWrite(uint32_t value);
+  // Called from every core's POLL event.
+  void poll(Emulator& core);
+
+private:
+  Emulator& boot;
+  // cores 1..N-1
+  vector<unique_ptr<Emulator>> cores;
+  vector<thread> threads;
+  mutex devices;
+  atomic<bool> halted{false};
+};
+
+#endif //SMP_HPP
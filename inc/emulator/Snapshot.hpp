@@ -0,0 +1,35 @@
+#ifndef SNAPSHOT_HPP
+#define SNAPSHOT_HPP
+
+#include <cstdint>
+
+// Snapshot file: header, pending events, the addresses of the saved pages,
+// then the page contents starting at a PAGE_SIZE aligned offset so restore
+// can map them straight from the file. Only pages the guest wrote since the
+// program was loaded are saved, restore loads the program first.
+const uint32_t SNAPSHOT_MAGIC = 0x33504E53; // "SNP3"
+
+struct SnapshotHeader {
+  uint32_t magic;
+  uint32_t eventCount;
+  uint32_t pageCount;
+  uint32_t pageOffset;
+  int32_t gpr[16];
+  int32_t pc, status, handler, cause;
+  uint64_t instret;
+  uint64_t nextFlush, nextTimer;
+  uint32_t timerCfg;
+  uint32_t termIn;
+  uint32_t dmaSource, dmaDestination, dmaLength, dmaControl;
+  uint32_t diskSector, diskBuffer, diskCount, diskControl;
+  uint64_t inputPosition;
+  uint8_t timerInterrupt, terminalInterrupt, dmaInterrupt, diskInterrupt;
+  uint8_t inputConsumed, ipiPending;
+};
+
+struct SnapshotEvent {
+  uint64_t when;
+  uint32_t type;
+};
+
+#endif //SNAPSHOT_HPP
@@ -0,0 +1,74 @@
+#ifndef SYMBOL_RANGES_HPP
+#define SYMBOL_RANGES_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Per-symbol statistics for the reports. Each symbol covers the addresses
+// up to the next one, code before the first symbol goes to "[no symbol]".
+// The range of the last lookup is kept, so looking up consecutive
+// instructions of one function is two compares.
+template<typename Stats>
+class SymbolRanges {
+public:
+  SymbolRanges(const map<string, uint32_t>& symbols){
+    vector<pair<uint32_t, string>> sorted;
+    for(auto& symbol: symbols) sorted.push_back({symbol.second, symbol.first});
+    sort(sorted.begin(), sorted.end());
+    for(auto& symbol: sorted){
+      // several names for one address go to the first of them
+      if(!starts.empty() && starts.back() == symbol.first) continue;
+      starts.push_back(symbol.first);
+      names.push_back(symbol.second);
+    }
+    names.push_back("[no symbol]");
+    stats.resize(names.size());
+  }
+
+  Stats& at(uint32_t pc){
+    if(pc < currentStart || pc >= currentEnd) enter(pc);
+    return *current;
+  }
+
+  // Name of the symbol covering pc and how far pc lies past it, nullptr
+  // for code before the first symbol.
+  const string* symbol(uint32_t pc, uint32_t& offset){
+    at(pc);
+    if(current == &stats.back()) return nullptr;
+    offset = pc - currentStart;
+    return &names[current - stats.data()];
+  }
+
+  // Calls visit(name, stats) for every symbol.
+  template<typename Visit>
+  void forEach(Visit visit) const {
+    for(size_t i = 0; i < stats.size(); i++) visit(names[i], stats[i]);
+  }
+
+private:
+  vector<uint32_t> starts;
+  vector<string> names;
+  vector<Stats> stats;
+  Stats* current = nullptr;
+  uint32_t currentStart = 1, currentEnd = 0;
+
+  void enter(uint32_t pc){
+    size_t i = upper_bound(starts.begin(), starts.end(), pc) - starts.begin();
+    if(i == 0){
+      current = &stats.back();
+      currentStart = 0;
+      currentEnd = starts.empty() ? UINT32_MAX : starts[0];
+    }
+    else{
+      current = &stats[i - 1];
+      currentStart = starts[i - 1];
+      currentEnd = i < starts.size() ? starts[i] : UINT32_MAX;
+    }
+  }
+};
+
+#endif //SYMBOL_RANGES_HPP
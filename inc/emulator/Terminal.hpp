@@ -1,18 +1,52 @@
 #ifndef TERMINAL_CPP
 #define TERMINAL_CPP
 #include <iostream>
+#include <string>
 #include <termios.h>
 
+// Console device. Output is collected in a buffer that is written out on
+// newline, when it fills up and whenever the emulator calls flush(); with
+// buffered off every byte is written and flushed right away.
+//
+// Interactively the terminal puts stdin in raw mode and the I/O thread
+// reads it, handing the bytes over through received(); each poll delivers
+// the next one. Headless it never touches the tty: input comes from a
+// string, one byte per poll once the guest has read the previous one, and
+// output goes to any stream.
 class Terminal {
 public:
+  static const size_t OUTPUT_BUFFER_SIZE = 4096;
+
   bool interrupt = false;
+  bool buffered = true;
   termios t;
   tcflag_t oldFlags;
-  uint32_t term_in;
-  Terminal();
-  void update();
+  uint32_t term_in = 0;
+  std::string output;
+  Terminal(std::ostream& out = std::cout) : out(&out) {}
+  void openConsole();
+  void setInput(const std::string& input);
+  // Console input read by the I/O thread.
+  void received(const std::string& data);
+  // Returns true if a new byte arrived in term_in.
+  bool update();
+  uint32_t read();
   void write(uint32_t);
+  void flush();
+  bool hasOutput() const {return !output.empty(); }
+  // How far scripted input got, saved with snapshots.
+  size_t inputOffset() const {return inputPosition; }
+  bool inputConsumed() const {return consumed; }
+  void resumeInput(size_t offset, bool consumed);
   ~Terminal();
+
+private:
+  std::ostream* out;
+  bool console = false;
+  bool headless = false;
+  std::string input;
+  size_t inputPosition = 0;
+  bool consumed = true;
 };
 
-#endif //TERMINAL_HPP
\ No newline at end of file
+#endif //TERMINAL_HPP
@@ -0,0 +1,48 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Fixed set of worker threads, each with its own task deque. Tasks are handed
+// out round robin; a worker runs its own tasks newest first and steals the
+// oldest task of another worker once its deque is empty, so long-running
+// programs don't leave the other workers idle.
+class ThreadPool {
+public:
+  ThreadPool(unsigned threads);
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+  ~ThreadPool();
+
+  void submit(function<void()> task);
+  // Blocks until every submitted task has finished.
+  void wait();
+
+private:
+  struct Queue {
+    mutex lock;
+    deque<function<void()>> tasks;
+  };
+
+  vector<unique_ptr<Queue>> queues;
+  vector<thread> workers;
+  atomic<unsigned> nextQueue{0};
+  atomic<size_t> queued{0};
+  size_t pending = 0;
+  bool stopping = false;
+  mutex stateLock;
+  condition_variable taskAvailable, allDone;
+
+  void work(unsigned index);
+  bool take(unsigned index, function<void()>& task);
+};
+
+#endif //THREAD_POOL_HPP
@@ -0,0 +1,28 @@
+#ifndef TIMER_HPP
+#define TIMER_HPP
+
+#include <chrono>
+#include <cstdint>
+
+// Periodic interrupt source. tim_cfg (0xFFFFFF10) selects one of eight
+// periods; writing it restarts the current period. The emulator drops
+// ticks while the guest has no interrupt handler installed.
+class Timer {
+public:
+  static const uint32_t PERIODS_MS[8];
+
+  bool interrupt = false;
+  uint32_t cfg = 0;
+
+  uint32_t periodMs() const {return PERIODS_MS[cfg & 0x7]; }
+
+  void configure(uint32_t value);
+  void restart();
+  // Host clock mode: returns true once per elapsed period.
+  bool expired();
+
+private:
+  std::chrono::steady_clock::time_point deadline;
+};
+
+#endif //TIMER_HPP
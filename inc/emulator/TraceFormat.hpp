@@ -0,0 +1,68 @@
+#ifndef TRACE_FORMAT_HPP
+#define TRACE_FORMAT_HPP
+
+#include <cstdint>
+#include <cstring>
+
+// Instruction trace file: a TraceHeader with the state before the first
+// instruction, then one record per executed instruction:
+//
+//   flags                       TRACE_* bits
+//   pc delta                    zigzag varint from the previous pc, unless
+//                               TRACE_SEQUENTIAL (pc = previous pc + 4)
+//   code                        4 bytes, unless TRACE_SAME_CODE (the code
+//                               last seen in the same code cache slot)
+//   register mask, deltas       if TRACE_REGISTERS: varint mask of changed
+//                               gprs, then a zigzag varint per changed gpr
+//   write count, writes         if TRACE_WRITES: varint count, then per
+//                               write a zigzag varint address delta from
+//                               the previous write and a varint value
+//
+// Writes done while entering an interrupt handler show up in the record of
+// the first handler instruction.
+const uint32_t TRACE_MAGIC = 0x31435254; // "TRC1"
+const uint32_t TRACE_CODE_CACHE = 4096;
+
+const uint8_t TRACE_SEQUENTIAL = 0x01;
+const uint8_t TRACE_SAME_CODE = 0x02;
+const uint8_t TRACE_REGISTERS = 0x04;
+const uint8_t TRACE_WRITES = 0x08;
+
+struct TraceHeader {
+  uint32_t magic;
+  uint32_t pc;
+  int32_t gpr[16];
+};
+
+inline uint32_t traceSlot(uint32_t pc) {return (pc >> 2) & (TRACE_CODE_CACHE - 1); }
+
+inline uint32_t zigzag(int32_t value) {return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31); }
+inline int32_t unzigzag(uint32_t value) {return static_cast<int32_t>(value >> 1) ^ -static_cast<int32_t>(value & 1); }
+
+// Stores all five possible varint bytes at once, so p needs 8 writable
+// bytes, and advances p by the length of the encoding. Register values are
+// often large, a byte-at-a-time loop would mispredict on most of them.
+inline uint8_t* putVarint(uint8_t* p, uint32_t value) {
+  uint64_t v = value;
+  uint64_t bytes = (v & 0x7F) | (v << 1 & 0x7F00) | (v << 2 & 0x7F0000) |
+                   (v << 3 & 0x7F000000) | (v << 4 & 0x7F00000000);
+  int bits = 32 - __builtin_clz(value | 1);
+  int length = 1 + (bits > 7) + (bits > 14) + (bits > 21) + (bits > 28);
+  bytes |= 0x80808080ull & ((1ull << (8 * (length - 1))) - 1);
+  memcpy(p, &bytes, 8);
+  return p + length;
+}
+
+// Returns nullptr if the varint runs past end.
+inline const uint8_t* getVarint(const uint8_t* p, const uint8_t* end, uint32_t& value) {
+  value = 0;
+  for(int shift = 0; shift < 35; shift += 7){
+    if(p == end) return nullptr;
+    uint8_t byte = *p++;
+    value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+    if(!(byte & 0x80)) return p;
+  }
+  return nullptr;
+}
+
+#endif //TRACE_FORMAT_HPP
@@ -0,0 +1,112 @@
+#ifndef TRACER_HPP
+#define TRACER_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "TraceFormat.hpp"
+using namespace std;
+
+// Records every executed instruction into a ring of chunks that a
+// background thread writes to the trace file. The emulator thread only
+// blocks when the writer falls a whole ring behind.
+class Tracer {
+public:
+  static const size_t CHUNK_SIZE = 1 << 20;
+  static const size_t CHUNK_COUNT = 8;
+  static const uint32_t MAX_WRITES = 8;
+  static const size_t MAX_RECORD = 16 + 16 * 5 + MAX_WRITES * 10 + 8;
+
+  Tracer(const string& filename, const int* gpr, uint32_t pc);
+  Tracer(const Tracer&) = delete;
+  Tracer& operator=(const Tracer&) = delete;
+  ~Tracer();
+
+  // Writes beyond MAX_WRITES in one instruction are not recorded, no
+  // instruction and interrupt entry together do that many.
+  void memoryWrite(uint32_t address, uint32_t value) {
+    if(writeCount < MAX_WRITES) writes[writeCount++] = {address, value};
+  }
+
+  // gpr is the register file after the instruction at pc ran.
+  void record(uint32_t pc, uint32_t code, const int* gpr) {
+    if(limit - cursor < (ptrdiff_t) MAX_RECORD) submit();
+    uint8_t* start = cursor;
+    uint8_t* p = start + 1;
+    uint8_t flags = 0;
+
+    uint32_t previous = lastPc;
+    lastPc = pc;
+    if(pc == previous + 4) flags |= TRACE_SEQUENTIAL;
+    else p = putVarint(p, zigzag(pc - previous));
+
+    uint32_t& cached = codes[traceSlot(pc)];
+    if(cached == code) flags |= TRACE_SAME_CODE;
+    else{
+      cached = code;
+      memcpy(p, &code, 4);
+      p += 4;
+    }
+
+    // changed registers are collected without branching, usually there are
+    // only one or two to encode
+    uint32_t mask = 0;
+    for(int r = 1; r < 15; r++){
+      mask |= static_cast<uint32_t>(gpr[r] != shadow[r]) << r;
+    }
+    if(mask != 0){
+      flags |= TRACE_REGISTERS;
+      p = putVarint(p, mask);
+      for(; mask != 0; mask &= mask - 1){
+        int r = __builtin_ctz(mask);
+        // in uint32_t, the difference of two guest values may not fit an int
+        p = putVarint(p, zigzag(static_cast<uint32_t>(gpr[r]) - static_cast<uint32_t>(shadow[r])));
+        shadow[r] = gpr[r];
+      }
+    }
+
+    if(writeCount != 0){
+      flags |= TRACE_WRITES;
+      p = memoryWrites(p);
+    }
+
+    *start = flags;
+    cursor = p;
+  }
+
+private:
+  struct Write {
+    uint32_t address;
+    uint32_t value;
+  };
+
+  FILE* file;
+  vector<vector<uint8_t>> chunks;
+  size_t lengths[CHUNK_COUNT];
+  uint8_t* cursor;
+  uint8_t* limit;
+  // chunks handed to the writer and chunks it has written, both counting up
+  size_t filling = 0, written = 0;
+  bool stopping = false;
+  mutex lock;
+  condition_variable chunkReady, chunkFree;
+  thread writer;
+
+  uint32_t lastPc, lastWrite = 0;
+  int shadow[16];
+  uint32_t codes[TRACE_CODE_CACHE];
+  Write writes[MAX_WRITES];
+  uint32_t writeCount = 0;
+
+  uint8_t* memoryWrites(uint8_t* p);
+  void submit();
+  void writeChunks();
+};
+
+#endif //TRACER_HPP
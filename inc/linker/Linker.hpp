@@ -5,6 +5,7 @@
 #include <vector>
 #include <map>
 #include <fstream>
+#include "../emulator/Executable.hpp"
 using namespace std;
 
 
@@ -70,7 +71,7 @@ struct SectionH {
 };
 
 void writeToFile(const std::string& filename, const std::vector<Section_>& sections, const std::vector<Symbol_>& symbols, const std::vector<Relocation_>& relocations);
-void writeToFile(const std::string& filename, const map<uint32_t, uint8_t>);
+void writeToFile(const std::string& filename, const map<uint32_t, uint8_t>, const map<string, uint32_t>& symbols);
 
 class File;
 
@@ -0,0 +1,57 @@
+#include "../../inc/emulator/Batch.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+#include "../../inc/emulator/ThreadPool.hpp"
+#include <fstream>
+#include <sstream>
+
+RunResult runHeadless(const string& program, Options options){
+  RunResult result;
+  result.program = program;
+  options.headless = true;
+  ostringstream out;
+  try
+  {
+    Emulator emulator(program, options, out);
+    emulator.start();
+    result.state = stopMessage(emulator.stopped());
+    result.instructions = emulator.instructionCount();
+  }
+  catch(const exception& e)
+  {
+    result.state = string("error: ") + e.what();
+  }
+  result.output = out.str();
+  return result;
+}
+
+int runBatch(const vector<string>& programs, const Options& options){
+  vector<RunResult> results(programs.size());
+  {
+    unsigned jobs = options.jobs != 0 ? options.jobs : thread::hardware_concurrency();
+    ThreadPool pool(jobs);
+    for(size_t i = 0; i < programs.size(); i++){
+      pool.submit([&programs, &results, &options, i]{
+        Options runOptions = options;
+        // every job answers SIGUSR1, each into a file of its own
+        runOptions.snapshotName = programs[i] + "." + options.snapshotName;
+        ifstream inFile(programs[i] + ".in", ios::binary);
+        if(inFile){
+          stringstream content;
+          content << inFile.rdbuf();
+          runOptions.input = content.str();
+        }
+        results[i] = runHeadless(programs[i], runOptions);
+      });
+    }
+    pool.wait();
+  }
+
+  int status = 0;
+  for(RunResult& result: results){
+    ofstream outFile(result.program + ".out", ios::binary);
+    outFile << result.output;
+    cout << result.program << ": " << result.state << ", " << result.instructions << " instructions" << endl;
+    if(result.state != "halted") status = 1;
+  }
+  return status;
+}
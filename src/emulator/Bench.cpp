@@ -0,0 +1,184 @@
+#include "../../inc/emulator/Bench.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char* coreName(Core core){
+  switch (core)
+  {
+  case Core::SWITCH: return "switch";
+  case Core::THREADED: return "threaded";
+  case Core::JIT: return "jit";
+  default: return "cached";
+  }
+}
+
+static BenchResult measure(const string& program, const Options& options){
+  BenchResult result;
+  result.program = program;
+  try
+  {
+    for(unsigned run = 0; run < options.benchRuns; run++){
+      ostringstream out;
+      Emulator emulator(program, options, out);
+      auto begin = chrono::steady_clock::now();
+      emulator.start();
+      double seconds = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+      if(run == 0 || seconds < result.seconds) result.seconds = seconds;
+      result.state = stopMessage(emulator.stopped());
+      result.instructions = emulator.instructionCount();
+    }
+  }
+  catch(const exception& e)
+  {
+    result.state = string("error: ") + e.what();
+  }
+  return result;
+}
+
+// The child measures and sends "instructions seconds state" back through a
+// pipe, the parent collects its peak RSS when it exits.
+static BenchResult measureInChild(const string& program, const Options& options){
+  BenchResult result;
+  result.program = program;
+  int fds[2];
+  if(pipe(fds) != 0){
+    result.state = "error: pipe failed";
+    return result;
+  }
+  pid_t child = fork();
+  if(child < 0){
+    close(fds[0]);
+    close(fds[1]);
+    result.state = "error: fork failed";
+    return result;
+  }
+  if(child == 0){
+    close(fds[0]);
+    BenchResult measured = measure(program, options);
+    ostringstream message;
+    message << measured.instructions << " " << setprecision(9) << measured.seconds << " " << measured.state;
+    string text = message.str();
+    for(size_t done = 0; done < text.size(); ){
+      ssize_t written = write(fds[1], text.data() + done, text.size() - done);
+      if(written <= 0) break;
+      done += written;
+    }
+    _exit(0);
+  }
+
+  close(fds[1]);
+  string text;
+  char buffer[256];
+  ssize_t count;
+  while((count = read(fds[0], buffer, sizeof(buffer))) > 0) text.append(buffer, count);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  if(wait4(child, &status, 0, &usage) == child) result.peakRssKb = usage.ru_maxrss;
+
+  istringstream message(text);
+  if(message >> result.instructions >> result.seconds){
+    message.get();
+    getline(message, result.state);
+  }
+  else result.state = "error: benchmark process died";
+  return result;
+}
+
+static string quote(const string& text){
+  string quoted = "\"";
+  for(char c: text){
+    if(c == '"' || c == '\\') quoted += '\\';
+    quoted += c;
+  }
+  return quoted + "\"";
+}
+
+// Text after "key": on a line of our own report, up to the next , or }, or
+// the unquoted string if the value is one.
+static bool field(const string& line, const string& key, string& value){
+  size_t start = line.find("\"" + key + "\": ");
+  if(start == string::npos) return false;
+  start += key.size() + 4;
+  value.clear();
+  if(line[start] == '"'){
+    for(size_t i = start + 1; i < line.size() && line[i] != '"'; i++){
+      if(line[i] == '\\') i++;
+      if(i < line.size()) value += line[i];
+    }
+  }
+  else value = line.substr(start, line.find_first_of(",}", start) - start);
+  return true;
+}
+
+// MIPS by program from a report written by an earlier run.
+static map<string, double> readBaseline(const string& name){
+  ifstream file(name);
+  if(!file) throw invalid_argument("Failed to open baseline " + name);
+  map<string, double> baseline;
+  string line, program, mips;
+  while(getline(file, line)){
+    if(field(line, "program", program) && field(line, "mips", mips)) baseline[program] = stod(mips);
+  }
+  return baseline;
+}
+
+int runBenchmark(const vector<string>& programs, const Options& options){
+  map<string, double> baseline;
+  if(!options.baseline.empty()){
+    try
+    {
+      baseline = readBaseline(options.baseline);
+    }
+    catch(const exception& e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+
+  int status = 0;
+  vector<string> regressions;
+  cout << "{" << endl;
+  cout << "  \"core\": \"" << coreName(options.core) << "\"," << endl;
+  cout << "  \"runs\": " << options.benchRuns << "," << endl;
+  cout << "  \"benchmarks\": [" << endl;
+  for(size_t i = 0; i < programs.size(); i++){
+    BenchResult result = measureInChild(programs[i], options);
+    double mips = result.seconds > 0 ? result.instructions / result.seconds / 1e6 : 0;
+    double nsPerInstruction = result.instructions != 0 ? result.seconds * 1e9 / result.instructions : 0;
+    if(result.state != "halted") status = 1;
+
+    cout << "    {\"program\": " << quote(result.program) << ", \"state\": " << quote(result.state)
+         << ", \"instructions\": " << result.instructions << fixed << setprecision(6)
+         << ", \"seconds\": " << result.seconds << setprecision(3)
+         << ", \"mips\": " << mips << ", \"ns_per_instruction\": " << nsPerInstruction
+         << ", \"peak_rss_kb\": " << result.peakRssKb;
+    auto base = baseline.find(result.program);
+    if(base != baseline.end() && base->second > 0){
+      double change = 100.0 * (mips - base->second) / base->second;
+      bool regression = change < -options.benchTolerance;
+      cout << ", \"baseline_mips\": " << base->second << ", \"change_percent\": " << change
+           << ", \"regression\": " << (regression ? "true" : "false");
+      if(regression){
+        ostringstream message;
+        message << result.program << ": " << fixed << setprecision(1) << -change << "% slower than baseline";
+        regressions.push_back(message.str());
+        status = 1;
+      }
+    }
+    cout << "}" << (i + 1 < programs.size() ? "," : "") << endl;
+    cout.unsetf(ios_base::floatfield);
+  }
+  cout << "  ]" << endl;
+  cout << "}" << endl;
+  for(const string& message: regressions) cerr << message << endl;
+  return status;
+}
@@ -0,0 +1,187 @@
+#include "../../inc/emulator/Cache.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+static bool isPowerOfTwo(uint32_t value){
+  return value != 0 && (value & (value - 1)) == 0;
+}
+
+static uint32_t shiftOf(uint32_t value){
+  uint32_t bits = 0;
+  while((1u << bits) < value) bits++;
+  return bits;
+}
+
+static const char* policyName(Replacement policy){
+  switch (policy)
+  {
+  case Replacement::FIFO: return "fifo";
+  case Replacement::RANDOM: return "random";
+  default: return "lru";
+  }
+}
+
+CacheLevel CacheLevel::parse(const string& spec){
+  vector<string> fields;
+  size_t start = 0;
+  while(true){
+    size_t end = spec.find(':', start);
+    fields.push_back(spec.substr(start, end - start));
+    if(end == string::npos) break;
+    start = end + 1;
+  }
+  if(fields.size() < 3 || fields.size() > 4){
+    throw invalid_argument("Cache level must be size:ways:line[:policy], got " + spec);
+  }
+  CacheLevel level;
+  size_t end = 0;
+  uint64_t size = stoul(fields[0], &end);
+  string unit = fields[0].substr(end);
+  if(unit == "k" || unit == "K") size <<= 10;
+  else if(unit == "m" || unit == "M") size <<= 20;
+  else if(!unit.empty()) throw invalid_argument("Unknown size unit in " + spec);
+  level.size = size;
+  level.ways = stoul(fields[1]);
+  level.lineSize = stoul(fields[2]);
+  if(fields.size() == 4){
+    if(fields[3] == "lru") level.policy = Replacement::LRU;
+    else if(fields[3] == "fifo") level.policy = Replacement::FIFO;
+    else if(fields[3] == "random") level.policy = Replacement::RANDOM;
+    else throw invalid_argument("Unknown replacement policy " + fields[3]);
+  }
+  if(size > UINT32_MAX || !isPowerOfTwo(level.size) || !isPowerOfTwo(level.ways) ||
+     !isPowerOfTwo(level.lineSize) || level.lineSize < 4 || level.size < level.ways * level.lineSize){
+    throw invalid_argument("Cache size, ways and line size must be powers of two with size >= ways * line, got " + spec);
+  }
+  return level;
+}
+
+Cache::Cache(const CacheLevel& level)
+  : config(level), lineBits(shiftOf(level.lineSize)),
+    setMask(level.size / (level.ways * level.lineSize) - 1), lines(level.size / level.lineSize){
+}
+
+bool Cache::access(uint32_t address, bool write, bool& writeback, uint32_t& evicted){
+  uint32_t line = address >> lineBits;
+  Line* set = &lines[(line & setMask) * config.ways];
+  writeback = false;
+  clock++;
+  for(uint32_t way = 0; way < config.ways; way++){
+    if(set[way].valid && set[way].tag == line){
+      hits++;
+      if(config.policy == Replacement::LRU) set[way].stamp = clock;
+      set[way].dirty |= write;
+      return true;
+    }
+  }
+  misses++;
+  Line& fill = set[victim(set)];
+  if(fill.valid && fill.dirty){
+    writebacks++;
+    writeback = true;
+    evicted = fill.tag << lineBits;
+  }
+  fill.valid = true;
+  fill.tag = line;
+  fill.dirty = write;
+  fill.stamp = clock;
+  return false;
+}
+
+// Empty ways first, then the oldest stamp: last use for LRU, fill time for
+// FIFO. Random uses a fixed xorshift sequence so runs are reproducible.
+uint32_t Cache::victim(Line* set){
+  for(uint32_t way = 0; way < config.ways; way++){
+    if(!set[way].valid) return way;
+  }
+  if(config.policy == Replacement::RANDOM){
+    random ^= random << 13;
+    random ^= random >> 17;
+    random ^= random << 5;
+    return random & (config.ways - 1);
+  }
+  uint32_t oldest = 0;
+  for(uint32_t way = 1; way < config.ways; way++){
+    if(set[way].stamp < set[oldest].stamp) oldest = way;
+  }
+  return oldest;
+}
+
+CacheModel::CacheModel(const CacheLevel& l1i, const CacheLevel& l1d, const CacheLevel& l2,
+                       uint32_t l2Latency, uint32_t memoryLatency, const map<string, uint32_t>& symbols)
+  : l1i(l1i), l1d(l1d), l2(l2), l2Latency(l2Latency), memoryLatency(memoryLatency), functions(symbols){
+  function = &functions.at(0);
+}
+
+void CacheModel::data(uint32_t address, uint32_t size, bool write){
+  uint32_t lineSize = l1d.level().lineSize;
+  uint32_t first = address & ~(lineSize - 1);
+  uint32_t last = (address + size - 1) & ~(lineSize - 1);
+  function->l1dAccesses++;
+  access(l1d, first, write, function->l1dMisses);
+  if(last != first) access(l1d, last, write, function->l1dMisses);
+}
+
+// Write-backs from L1 go to L2 without stalling the instruction.
+void CacheModel::access(Cache& l1, uint32_t address, bool write, uint64_t& l1Misses){
+  bool writeback;
+  uint32_t evicted, ignored;
+  if(l1.access(address, write, writeback, evicted)) return;
+  l1Misses++;
+  if(writeback) l2.access(evicted, true, writeback, ignored);
+  function->cycles += l2Latency;
+  if(!l2.access(address, false, writeback, ignored)){
+    function->l2Misses++;
+    function->cycles += memoryLatency;
+  }
+}
+
+void CacheModel::writeReport(const string& base) const {
+  vector<pair<const string*, const Function*>> sorted;
+  uint64_t instructions = 0, cycles = 0;
+  functions.forEach([&](const string& name, const Function& f){
+    instructions += f.instructions;
+    cycles += f.cycles;
+    if(f.instructions != 0) sorted.push_back({&name, &f});
+  });
+  sort(sorted.begin(), sorted.end(), [](const pair<const string*, const Function*>& a,
+                                        const pair<const string*, const Function*>& b){
+    return a.second->cycles > b.second->cycles;
+  });
+
+  ofstream report(base + ".txt");
+  report << fixed << setprecision(2);
+  report << "Instructions executed: " << instructions << endl;
+  report << "Estimated cycles: " << cycles << " (CPI "
+         << (instructions == 0 ? 0.0 : (double) cycles / instructions) << ")" << endl;
+  report << "Latency: L2 " << l2Latency << " cycles, memory " << memoryLatency << " cycles" << endl;
+
+  report << endl << left << setw(6) << "Level" << right << setw(10) << "Size" << setw(6) << "Ways"
+         << setw(6) << "Line" << setw(8) << "Policy" << setw(14) << "Accesses" << setw(14) << "Misses"
+         << setw(10) << "Miss%" << setw(14) << "Writebacks" << endl;
+  auto level = [&report](const char* name, const Cache& cache){
+    uint64_t accesses = cache.hits + cache.misses;
+    report << left << setw(6) << name << right << setw(10) << cache.level().size
+           << setw(6) << cache.level().ways << setw(6) << cache.level().lineSize
+           << setw(8) << policyName(cache.level().policy) << setw(14) << accesses
+           << setw(14) << cache.misses << setw(9) << (accesses == 0 ? 0.0 : 100.0 * cache.misses / accesses)
+           << "%" << setw(14) << cache.writebacks << endl;
+  };
+  level("L1I", l1i);
+  level("L1D", l1d);
+  level("L2", l2);
+
+  report << endl << "Cycles by symbol:" << endl;
+  report << "  " << left << setw(32) << "Symbol" << right << setw(14) << "Instructions" << setw(14) << "Cycles"
+         << setw(8) << "%" << setw(12) << "L1I miss" << setw(14) << "L1D access" << setw(12) << "L1D miss"
+         << setw(12) << "L2 miss" << endl;
+  for(auto& entry: sorted){
+    const Function* f = entry.second;
+    report << "  " << left << setw(32) << *entry.first << right << setw(14) << f->instructions
+           << setw(14) << f->cycles << setw(7) << (cycles == 0 ? 0.0 : 100.0 * f->cycles / cycles) << "%"
+           << setw(12) << f->l1iMisses << setw(14) << f->l1dAccesses << setw(12) << f->l1dMisses
+           << setw(12) << f->l2Misses << endl;
+  }
+}
@@ -0,0 +1,64 @@
+#include "../../inc/emulator/CostModel.hpp"
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+CostModel::CostModel(const string& configName, const map<string, uint32_t>& symbols) : functions(symbols){
+  latency.fill(1);
+  if(!configName.empty()) load(configName);
+}
+
+void CostModel::load(const string& configName){
+  ifstream config(configName);
+  if(!config) throw ios_base::failure("Failed to open cost model " + configName);
+  string line;
+  for(uint32_t number = 1; getline(config, line); number++){
+    line = line.substr(0, line.find('#'));
+    istringstream fields(line);
+    string key;
+    if(!(fields >> key)) continue;
+    uint32_t cycles;
+    string rest;
+    if(!(fields >> cycles) || fields >> rest){
+      throw invalid_argument(configName + ":" + to_string(number) + ": expected key and cycles");
+    }
+    if(key == "indirect") indirect = cycles;
+    else if(key == "pool") pool = cycles;
+    else if(key.size() == 2 && isxdigit(key[0]) && isxdigit(key[1])) latency[stoul(key, nullptr, 16)] = cycles;
+    else throw invalid_argument(configName + ":" + to_string(number) + ": unknown key " + key);
+  }
+}
+
+void CostModel::printReport(ostream& out) const {
+  vector<pair<const string*, const Function*>> sorted;
+  uint64_t instructions = 0, cycles = 0;
+  functions.forEach([&](const string& name, const Function& f){
+    instructions += f.instructions;
+    cycles += f.cycles;
+    if(f.instructions != 0) sorted.push_back({&name, &f});
+  });
+  sort(sorted.begin(), sorted.end(), [](const pair<const string*, const Function*>& a,
+                                        const pair<const string*, const Function*>& b){
+    return a.second->cycles > b.second->cycles;
+  });
+
+  ios_base::fmtflags flags = out.flags();
+  char fill = out.fill(' ');
+  out << fixed << setprecision(2);
+  out << "Simulated cycles: " << cycles << " (CPI "
+      << (instructions == 0 ? 0.0 : (double) cycles / instructions) << ")" << endl;
+  out << "Cycles by symbol:" << endl;
+  out << "  " << left << setw(32) << "Symbol" << right << setw(14) << "Instructions" << setw(14) << "Cycles"
+      << setw(8) << "CPI" << setw(8) << "%" << endl;
+  for(auto& entry: sorted){
+    const Function* f = entry.second;
+    out << "  " << left << setw(32) << *entry.first << right << setw(14) << f->instructions
+        << setw(14) << f->cycles << setw(8) << (double) f->cycles / f->instructions
+        << setw(7) << (cycles == 0 ? 0.0 : 100.0 * f->cycles / cycles) << "%" << endl;
+  }
+  out.flags(flags);
+  out.fill(fill);
+}
@@ -0,0 +1,182 @@
+#include "../../inc/emulator/Disk.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <ios>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Disk::Disk(const string& fileName, Memory& memory, IoThread& io) : Device(BASE, LAST, 7), memory(memory), io(io){
+  fd = open(fileName.c_str(), O_RDWR);
+  if(fd < 0){
+    fd = open(fileName.c_str(), O_RDONLY);
+    writable = false;
+  }
+  if(fd < 0) throw ios_base::failure("Failed to open disk " + fileName);
+  struct stat st;
+  if(fstat(fd, &st) < 0){
+    close(fd);
+    throw ios_base::failure("Failed to read disk size " + fileName);
+  }
+  sectors = min<uint64_t>(st.st_size / SECTOR_SIZE, UINT32_MAX);
+}
+
+// Pages mapped from the file stay valid after it is closed.
+Disk::~Disk(){
+  close(fd);
+}
+
+uint32_t Disk::read(uint32_t address){
+  switch (address)
+  {
+  case BASE: return sector;
+  case BASE + 4: return buffer;
+  case BASE + 8: return count;
+  case BASE + 12: return control;
+  default: return sectors;
+  }
+}
+
+void Disk::write(uint32_t address, uint32_t value){
+  if(control & BUSY) return;
+  switch (address)
+  {
+  case BASE: sector = value; break;
+  case BASE + 4: buffer = value; break;
+  case BASE + 8: count = value; break;
+  case BASE + 12:
+    control = value & ~(START | BUSY | ERROR | DONE);
+    if(value & START) start();
+    break;
+  default:
+    // disk_size is read-only
+    break;
+  }
+}
+
+void Disk::start(){
+  uint64_t offset = (uint64_t) sector * SECTOR_SIZE, length = (uint64_t) count * SECTOR_SIZE;
+  if((uint64_t) sector + count > sectors || ((control & WRITE) && !writable)){
+    finish(false);
+    return;
+  }
+  control |= BUSY;
+  runs.clear();
+  pieces.clear();
+  staged.clear();
+  if(control & WRITE){
+    detach(offset, length);
+    staged.resize(length);
+    for(uint64_t done = 0; done < length; ){
+      uint32_t address = buffer + done;
+      uint32_t chunk = min<uint64_t>(length - done, PAGE_SIZE - (address & PAGE_MASK));
+      Page* page = memory.findPage(address);
+      // untouched pages are zero, like staged
+      if(page != nullptr) memcpy(staged.data() + done, page->data + (address & PAGE_MASK), chunk);
+      done += chunk;
+    }
+    io.submit([this, offset]{
+      bool ok = writeFile(offset);
+      io.post([this, ok]{ finish(ok); });
+    });
+  }
+  else{
+    io.submit([this, target = buffer, offset, length]{
+      bool ok = readFile(target, offset, length);
+      io.post([this, ok]{
+        if(ok) placeRead();
+        finish(ok);
+      });
+    });
+  }
+}
+
+void Disk::finish(bool ok){
+  control = (control & ~BUSY) | DONE | (ok ? 0 : ERROR);
+  if(control & IRQ) interrupt = true;
+}
+
+// I/O thread. Runs of whole aligned pages are mapped, everything else is
+// read page by page. A run that cannot be mapped is read as well. The
+// registers belong to the CPU thread, the job gets their values.
+bool Disk::readFile(uint32_t target, uint64_t offset, uint64_t length){
+  uint64_t done = 0;
+  while(done < length){
+    uint32_t address = target + done;
+    uint64_t position = offset + done;
+    uint64_t remaining = length - done;
+    if((address & PAGE_MASK) == 0 && (position & PAGE_MASK) == 0 && remaining >= PAGE_SIZE){
+      // the run stops where the guest address space wraps around
+      uint32_t pages = min<uint64_t>(remaining >> PAGE_BITS, ((1ull << 32) - address) >> PAGE_BITS);
+      size_t size = (size_t) pages << PAGE_BITS;
+      // private, so guest stores never reach the file
+      void* image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, position);
+      if(image != MAP_FAILED){
+        runs.push_back({address, position, static_cast<uint8_t*>(image), size});
+        done += size;
+        continue;
+      }
+    }
+    uint32_t chunk = min<uint64_t>(remaining, PAGE_SIZE - (address & PAGE_MASK));
+    size_t start = staged.size();
+    staged.resize(start + chunk);
+    if(pread(fd, staged.data() + start, chunk, position) != (ssize_t) chunk){
+      // nothing of a failed read reaches the guest
+      for(Run& run: runs) munmap(run.image, run.size);
+      runs.clear();
+      return false;
+    }
+    pieces.push_back({address, start, chunk});
+    done += chunk;
+  }
+  return true;
+}
+
+// I/O thread.
+bool Disk::writeFile(uint64_t offset){
+  for(size_t done = 0; done < staged.size(); ){
+    ssize_t written = pwrite(fd, staged.data() + done, staged.size() - done, offset + done);
+    if(written <= 0) return false;
+    done += written;
+  }
+  return true;
+}
+
+// Pages filled by a read are marked dirty and reported to the write hook
+// like any other store. Memory unmaps a run once its pages are all
+// replaced, the entries left for them are dropped here.
+void Disk::placeRead(){
+  for(auto it = mapped.begin(); it != mapped.end(); ){
+    Page* page = memory.findPage(it->second.first);
+    if(page != nullptr && page->data == it->second.second) ++it;
+    else it = mapped.erase(it);
+  }
+  for(Run& run: runs){
+    memory.addMapping(run.image, run.size);
+    for(size_t at = 0; at < run.size; at += PAGE_SIZE){
+      uint32_t pageAddress = run.address + at;
+      memory.mapPage(pageAddress, run.image + at);
+      memory.written(*memory.findPage(pageAddress), pageAddress, PAGE_SIZE);
+      mapped.insert({(run.offset + at) >> PAGE_BITS, {pageAddress, run.image + at}});
+    }
+  }
+  for(Piece& piece: pieces){
+    Page& page = memory.getPage(piece.address);
+    memcpy(page.data + (piece.address & PAGE_MASK), staged.data() + piece.start, piece.length);
+    memory.written(page, piece.address, piece.length);
+  }
+}
+
+// A private mapping shows changes made to the file for as long as the guest
+// has not written the page, detach before writing.
+void Disk::detach(uint64_t offset, uint64_t length){
+  if(length == 0) return;
+  auto first = mapped.lower_bound(offset >> PAGE_BITS);
+  auto last = mapped.upper_bound((offset + length - 1) >> PAGE_BITS);
+  for(auto it = first; it != last; ++it){
+    Page* page = memory.findPage(it->second.first);
+    // a later read or restore may have replaced the page already
+    if(page != nullptr && page->data == it->second.second) memory.detachPage(it->second.first);
+  }
+  mapped.erase(first, last);
+}
@@ -0,0 +1,62 @@
+#include "../../inc/emulator/Dma.hpp"
+#include <algorithm>
+
+uint32_t Dma::read(uint32_t address){
+  switch (address)
+  {
+  case BASE: return source;
+  case BASE + 4: return destination;
+  case BASE + 8: return length;
+  default: return control;
+  }
+}
+
+void Dma::write(uint32_t address, uint32_t value){
+  if(busy()) return;
+  switch (address)
+  {
+  case BASE: source = value; break;
+  case BASE + 4: destination = value; break;
+  case BASE + 8: length = value; break;
+  default:
+    control = value & ~(START | BUSY | ERROR | DONE);
+    if(value & START) start();
+  }
+}
+
+void Dma::start(){
+  // nothing reaches the device registers, a range there would also wrap
+  const uint64_t limit = 0xFFFFFF00;
+  if((uint64_t) destination + length > limit ||
+     (!(control & FILL) && (uint64_t) source + length > limit)){
+    finish(DONE | ERROR);
+  }
+  else if(length == 0) finish(DONE);
+  else control |= BUSY;
+}
+
+bool Dma::step(){
+  uint32_t chunk = min(length, CHUNK);
+  if(control & FILL){
+    memory.fill(destination, source, chunk);
+    destination += chunk;
+  }
+  else if(destination > source && (uint64_t) source + length > destination){
+    // the front of the destination still overlaps source bytes to go
+    memory.copy(destination + length - chunk, source + length - chunk, chunk);
+  }
+  else{
+    memory.copy(destination, source, chunk);
+    source += chunk;
+    destination += chunk;
+  }
+  length -= chunk;
+  if(length != 0) return true;
+  finish(DONE);
+  return false;
+}
+
+void Dma::finish(uint32_t status){
+  control = (control & ~BUSY) | status;
+  if(control & IRQ) interrupt = true;
+}
@@ -2,142 +2,850 @@
 #include <fstream>
 #include <iomanip>
 #include "../../inc/emulator/Error.hpp"
+#include "../../inc/emulator/Executable.hpp"
+#include "../../inc/emulator/GdbStub.hpp"
+#include "../../inc/emulator/Handlers.hpp"
+#include "../../inc/emulator/Jit.hpp"
+#include "../../inc/emulator/Smp.hpp"
+#include <climits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 
-void readFromFile(const std::string& filename, std::map<uint32_t, uint8_t>& memory) {
-    std::ifstream inFile(filename, std::ios::binary);
-    if (!inFile) {
-        throw std::ios_base::failure("Failed to open file for reading");
+// Copies the segments into guest memory. Pages a segment covers completely
+// are used in place from the file mapping instead, when the linker placed
+// them on a page of the file. Returns the number of pages used in place.
+static size_t loadSegments(const uint8_t* image, size_t size, Memory& memory, map<string, uint32_t>& symbols) {
+    ExecutableHeader header;
+    memcpy(&header, image, sizeof(header));
+    size_t tableEnd = sizeof(header) + (size_t) header.segmentCount * sizeof(SegmentHeader);
+    if (tableEnd > size) {
+        throw std::ios_base::failure("Truncated segment table");
+    }
+    size_t mapped = 0;
+    for (uint32_t i = 0; i < header.segmentCount; ++i) {
+        SegmentHeader segment;
+        memcpy(&segment, image + sizeof(header) + i * sizeof(segment), sizeof(segment));
+        if ((size_t) segment.offset + segment.size > size) {
+            throw std::ios_base::failure("Segment payload out of file");
+        }
+        uint8_t* payload = const_cast<uint8_t*>(image) + segment.offset;
+        uint64_t address = segment.address;
+        uint64_t end = address + segment.size;
+        while (address < end) {
+            uint64_t pageEnd = (address & ~(uint64_t) PAGE_MASK) + PAGE_SIZE;
+            bool filePage = ((segment.offset + (address - segment.address)) & PAGE_MASK) == 0;
+            if ((address & PAGE_MASK) == 0 && pageEnd <= end && filePage) {
+                memory.mapPage(address, payload + (address - segment.address));
+                mapped++;
+            }
+            else {
+                for (; address < end && address < pageEnd; ++address) {
+                    memory.writeByte(address, payload[address - segment.address]);
+                }
+            }
+            address = pageEnd;
+        }
+    }
+
+    size_t position = header.symbolOffset;
+    for (uint32_t i = 0; i < header.symbolCount; ++i) {
+        uint32_t value, nameSize;
+        if (position + sizeof(value) + sizeof(nameSize) > size) {
+            throw std::ios_base::failure("Truncated symbol table");
+        }
+        memcpy(&value, image + position, sizeof(value));
+        memcpy(&nameSize, image + position + sizeof(value), sizeof(nameSize));
+        position += sizeof(value) + sizeof(nameSize);
+        if (position + nameSize > size) {
+            throw std::ios_base::failure("Truncated symbol table");
+        }
+        symbols[string(reinterpret_cast<const char*>(image) + position, nameSize)] = value;
+        position += nameSize;
     }
+    return mapped;
+}
 
-    // Read the size of the map
+// Old format: a record count followed by (uint32 address, uint8 byte) records.
+static void loadBytes(const uint8_t* image, size_t size, Memory& memory) {
     uint32_t mapSize;
-    inFile.read(reinterpret_cast<char*>(&mapSize), sizeof(mapSize));
-    if (!inFile) {
+    memcpy(&mapSize, image, sizeof(mapSize));
+    if (sizeof(mapSize) + (size_t) mapSize * 5 > size) {
+        throw std::ios_base::failure("Failed to read key-value pair");
+    }
+    const uint8_t* record = image + sizeof(mapSize);
+    for (uint32_t i = 0; i < mapSize; ++i, record += 5) {
+        uint32_t key;
+        memcpy(&key, record, sizeof(key));
+        memory.writeByte(key, record[4]);
+    }
+}
+
+void readFromFile(const std::string& filename, Memory& memory, map<string, uint32_t>& symbols) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::ios_base::failure("Failed to open file for reading");
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(uint32_t)) {
+        close(fd);
         throw std::ios_base::failure("Failed to read map size");
     }
+    size_t size = st.st_size;
+    // Private and writable: the guest can store to mapped pages without
+    // touching the file
+    void* image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (image == MAP_FAILED) {
+        throw std::ios_base::failure("Failed to map file");
+    }
 
-    // Read each key-value pair
-    memory.clear();  // Clear the map to ensure it's empty before reading
-    for (uint32_t i = 0; i < mapSize; ++i) {
-        uint32_t key;
-        uint8_t value;
-        inFile.read(reinterpret_cast<char*>(&key), sizeof(key));
-        inFile.read(reinterpret_cast<char*>(&value), sizeof(value));
-        if (!inFile) {
-            throw std::ios_base::failure("Failed to read key-value pair");
+    uint32_t magic;
+    memcpy(&magic, image, sizeof(magic));
+    if (magic == EXECUTABLE_MAGIC && size >= sizeof(ExecutableHeader)) {
+        // the mapping stays only while pages use it
+        memory.addMapping(image, size);
+        if (loadSegments(static_cast<uint8_t*>(image), size, memory, symbols) == 0) {
+            memory.dropMapping(image);
         }
-        memory[key] = value;
     }
+    else {
+        try {
+            loadBytes(static_cast<uint8_t*>(image), size, memory);
+        }
+        catch (...) {
+            munmap(image, size);
+            throw;
+        }
+        munmap(image, size);
+    }
+}
+
+const char* stopMessage(StopReason reason){
+  switch (reason)
+  {
+  case StopReason::HALT: return "halted";
+  case StopReason::INSTRUCTION_LIMIT: return "instruction limit";
+  case StopReason::TIMEOUT: return "timeout";
+  case StopReason::BREAKPOINT: return "breakpoint";
+  case StopReason::WATCHPOINT: return "watched word changed";
+  case StopReason::DEBUGGER: return "stopped by debugger";
+  default: return "running";
+  }
+}
+
+Emulator::Emulator(string inputName, Options options, ostream& out)
+  : ownMemory(new Memory()), memory(*ownMemory), options(options), out(out), terminal(out){
+  memory.writeHook = [this](uint32_t address, uint32_t size){ hookedWrite(address, size); };
+  readFromFile(inputName, memory, symbols);
+  memory.clearDirty();
+  for(const string& location: options.breakpoints){
+    breakpoints.insert(resolve(location));
+  }
+  for(const string& location: options.watchpoints){
+    addWatch(resolve(location));
+  }
 
-    inFile.close();
+  dma = &devices.attach(new Dma(memory));
+  if(!options.disk.empty()) disk = &devices.attach(new Disk(options.disk, memory, devices.io()));
+  if(options.headless) terminal.setInput(options.input);
+  else{
+    terminal.openConsole();
+    devices.io().watch(STDIN_FILENO, [this](const string& data){ terminal.received(data); });
+  }
+  terminal.buffered = options.bufferedOutput;
+  if(options.profile) profiler.reset(new Profiler(GPR[PC], symbols));
+  if(options.cache){
+    cache.reset(new CacheModel(options.l1i, options.l1d, options.l2,
+                               options.l2Latency, options.memoryLatency, symbols));
+  }
+  if(options.cost) cost.reset(new CostModel(options.costName, symbols));
+}
+
+// Starts at the entry point with cleared registers like core 0. Devices
+// and the run limits stay with core 0, this core only polls for
+// interrupts and for the machine to stop.
+Emulator::Emulator(Emulator& boot, uint32_t id)
+  : memory(boot.memory), options(boot.options), out(boot.out), terminal(boot.out), smp(boot.smp), coreId(id){
+  CSR[CORE_ID] = id;
+  dma = &devices.attach(new Dma(memory));
+  scheduler.schedule(0, EventType::POLL);
+}
+
+// Accepts a symbol from the executable or a decimal/0x-prefixed address.
+uint32_t Emulator::resolve(const string& location) const {
+  auto it = symbols.find(location);
+  if(it != symbols.end()) return it->second;
+  size_t end = 0;
+  uint32_t address = 0;
+  try
+  {
+    address = stoul(location, &end, 0);
+  }
+  catch(const exception&)
+  {
+    end = 0;
+  }
+  if(end == 0 || end != location.size()){
+    throw invalid_argument("Unknown symbol " + location);
+  }
+  return address;
+}
+
+void Emulator::hookedWrite(uint32_t address, uint32_t size){
+  if(jit != nullptr) jit->codeWritten(address, size);
+  for(Watch& watch: watches){
+    if(address > watch.address + 3 || address + size <= watch.address) continue;
+    uint32_t value = memory.readWord(watch.address);
+    if(value != watch.value){
+      watch.value = value;
+      watchHit = watch.address;
+      stop(StopReason::WATCHPOINT);
+    }
+  }
+}
+
+void Emulator::stop(StopReason reason){
+  if(stopReason == StopReason::NONE) stopReason = reason;
+  running = false;
+  nextEvent = 0;
 }
 
 
 void Emulator::start(){
-    while(running){
-      try
-      {
-        Instruction ins = readInstruction(pc);
-        pc += 4;
-        executeInstruction(ins);
-        terminal.update();
-        handleInterrupt();
+  unique_ptr<Smp> machine;
+  if(options.cores > 1) machine.reset(new Smp(*this));
+  logging = !options.recordName.empty() || !options.replayName.empty() || options.checkpointInterval != 0;
+  if(!options.replayName.empty()) loadEventLog(options.replayName);
+  if(!options.restoreName.empty()){
+    restoreSnapshot(options.restoreName);
+  }
+  else{
+    scheduler.schedule(instret, EventType::POLL);
+    scheduleTimer();
+  }
+  scheduleReplay();
+  if(options.checkpointInterval != 0){
+    takeCheckpoint();
+    scheduler.schedule(instret + options.checkpointInterval, EventType::CHECKPOINT);
+    nextEvent = min(nextEvent, instret + options.checkpointInterval);
+  }
+  if(options.snapshotAt != UINT64_MAX && options.snapshotAt >= instret){
+    scheduler.schedule(options.snapshotAt, EventType::SNAPSHOT);
+    nextEvent = min(nextEvent, options.snapshotAt);
+  }
+  if(options.maxInstret <= instret){
+    stop(StopReason::INSTRUCTION_LIMIT);
+  }
+  else if(options.maxInstret != UINT64_MAX){
+    scheduler.schedule(options.maxInstret, EventType::LIMIT);
+    nextEvent = min(nextEvent, options.maxInstret);
+  }
+  if(options.timeout != 0){
+    hasDeadline = true;
+    deadline = chrono::steady_clock::now() + chrono::milliseconds(options.timeout);
+  }
+  installSnapshotSignal();
+  if(!options.traceName.empty()) tracer.reset(new Tracer(options.traceName, GPR, GPR[PC]));
+  if(!options.gdb.empty()){
+    GdbStub stub(*this, options.gdb);
+    // a detached debugger leaves the guest running
+    if(stub.serve()) resume();
+  }
+  else if(machine) machine->run();
+  else run();
+  if(profiler) profiler->writeReport(options.profileName, instret);
+  if(cache) cache->writeReport(options.cacheName);
+  if(!options.recordName.empty()) saveEventLog(options.recordName);
+  // waits for the writer thread to finish the file
+  tracer.reset();
+  terminal.flush();
+  printProcessorState();
+  if(machine) machine->printState();
+  if(cost) cost->printReport(out);
+}
+
+// Runs the selected core until the guest halts or something stops it.
+void Emulator::run(){
+  static void (Emulator::*const hooked[])() = {
+    nullptr, &Emulator::runCached<1>, &Emulator::runCached<2>, &Emulator::runCached<3>,
+    &Emulator::runCached<4>, &Emulator::runCached<5>, &Emulator::runCached<6>, &Emulator::runCached<7>,
+    &Emulator::runCached<8>, &Emulator::runCached<9>, &Emulator::runCached<10>, &Emulator::runCached<11>,
+    &Emulator::runCached<12>, &Emulator::runCached<13>, &Emulator::runCached<14>, &Emulator::runCached<15>,
+  };
+  unsigned hooks = (profiler ? HOOK_PROFILE : 0) | (tracer ? HOOK_TRACE : 0) |
+                   (cache ? HOOK_CACHE : 0) | (cost ? HOOK_COST : 0);
+  fusion = hooks == 0;
+  if(hooks != 0) (this->*hooked[hooks])();
+  else switch (options.core)
+  {
+  case Core::SWITCH:
+    if(breakpoints.empty()) runSwitch<false>();
+    else runSwitch<true>();
+    break;
+  case Core::CACHED:
+    runCached<0>();
+    break;
+  case Core::THREADED:
+    runThreaded();
+    break;
+  case Core::JIT:
+    runJit();
+    break;
+  }
+  if(stopReason == StopReason::NONE) stopReason = StopReason::HALT;
+}
+
+// Clears the last stop so run loops can continue. stop() zeroed nextEvent.
+void Emulator::clearStop(){
+  running = true;
+  stopReason = StopReason::NONE;
+  nextEvent = fault != Fault::NONE ? 0 : scheduler.next();
+}
+
+void Emulator::resume(){
+  if(stopReason == StopReason::HALT) return;
+  // the breakpoint at pc has been reported, step off it first
+  if(isBreakpoint(GPR[PC])){
+    step();
+    if(!running) return;
+  }
+  clearStop();
+  run();
+}
+
+// Executes one instruction from memory, bypassing breakpoints in the
+// decode cache.
+void Emulator::step(){
+  if(stopReason == StopReason::HALT) return;
+  clearStop();
+  Instruction ins = readInstruction(GPR[PC]);
+  GPR[PC] += 4;
+  executeInstruction(ins);
+  if(++instret >= nextEvent) serviceEvents();
+  if(!running && stopReason == StopReason::NONE) stopReason = StopReason::HALT;
+}
+
+void Emulator::addBreakpoint(uint32_t address){
+  breakpoints.insert(address);
+  Page* page = memory.findPage(address);
+  if(page != nullptr) page->invalidate(address & PAGE_MASK, 4);
+  // compiled blocks do not check for breakpoints
+  if(jit) jit->codeWritten(address, 4);
+}
+
+void Emulator::removeBreakpoint(uint32_t address){
+  if(breakpoints.erase(address) == 0) return;
+  Page* page = memory.findPage(address);
+  if(page != nullptr) page->invalidate(address & PAGE_MASK, 4);
+  if(jit) jit->codeWritten(address, 4);
+}
+
+void Emulator::addWatch(uint32_t address){
+  for(Watch& watch: watches){
+    if(watch.address == address) return;
+  }
+  watches.push_back({address, memory.readWord(address)});
+  memory.getPage(address).hooked = true;
+  memory.getPage(address + 3).hooked = true;
+}
+
+void Emulator::removeWatch(uint32_t address){
+  for(size_t i = 0; i < watches.size(); i++){
+    if(watches[i].address == address){
+      watches.erase(watches.begin() + i);
+      return;
+    }
+  }
+}
+
+// Reference core: decodes every instruction from memory and dispatches it
+// through executeInstruction. It has no decode cache to put breakpoints in,
+// runSwitch<true> checks them before every instruction.
+template<bool BREAKPOINTS>
+void Emulator::runSwitch(){
+  while(running){
+    if(BREAKPOINTS && isBreakpoint(GPR[PC])){
+      stop(StopReason::BREAKPOINT);
+      break;
+    }
+    Instruction ins = readInstruction(GPR[PC]);
+    GPR[PC] += 4;
+    executeInstruction(ins);
+    if(++instret >= nextEvent) serviceEvents();
+  }
+}
+
+// Instruction word of a decoded instruction, for the trace. The sink slot
+// goes back to r0.
+static uint32_t encode(const DecodedInstruction& ins){
+  return (uint32_t) ins.op << 24 | (ins.regA & 0xF) << 20 | ins.regB << 16 | ins.regC << 12 | (ins.disp & 0xFFF);
+}
+
+// Reports the data accesses ins is about to make to the cache model, from
+// the registers as they are before it runs. Device registers are not cached.
+void Emulator::cacheAccesses(const DecodedInstruction& ins){
+  auto read = [this](uint32_t address){ if(address < 0xFFFFFF00) cache->read(address, 4); };
+  auto write = [this](uint32_t address){ if(address < 0xFFFFFF00) cache->write(address, 4); };
+  switch(ins.op){
+  case 0x20:
+    write(GPR[SP] - 4);
+    break;
+  case 0x21:
+    write(GPR[SP] - 4);
+    read(GPR[ins.regA] + GPR[ins.regB] + ins.disp);
+    break;
+  case 0x38:
+    read(GPR[ins.regA] + ins.disp);
+    break;
+  case 0x39:
+    if(GPR[ins.regB] == GPR[ins.regC]) read(GPR[ins.regA] + ins.disp);
+    break;
+  case 0x3A:
+    if(GPR[ins.regB] != GPR[ins.regC]) read(GPR[ins.regA] + ins.disp);
+    break;
+  case 0x3B:
+    if(GPR[ins.regB] > GPR[ins.regC]) read(GPR[ins.regA] + ins.disp);
+    break;
+  case 0x80:
+    write(GPR[ins.regA] + GPR[ins.regB] + ins.disp);
+    break;
+  case 0x81:
+    // the incremented register is r0 only when the write is discarded
+    write(ins.regA != 0 ? GPR[ins.regA] + ins.disp : 0);
+    break;
+  case 0x82: {
+    uint32_t pointer = GPR[ins.regA] + GPR[ins.regB] + ins.disp;
+    read(pointer);
+    if(pointer < 0xFFFFFF00) write(memory.readWord(pointer));
+    break;
+  }
+  case 0x92:
+  case 0x96:
+    read(GPR[ins.regB] + GPR[ins.regC] + ins.disp);
+    break;
+  case 0x93:
+  case 0x97:
+    read(GPR[ins.regB]);
+    break;
+  }
+}
+
+// Executes predecoded instructions through their handler pointers. The
+// profiling, tracing, cache simulation and cost model hooks are compiled
+// in only for the instantiations that have them in HOOKS.
+template<unsigned HOOKS>
+void Emulator::runCached(){
+  while(running){
+    if(HOOKS & HOOK_PROFILE) profiler->instruction(GPR[PC]);
+    if(HOOKS & HOOK_CACHE) cache->fetch(GPR[PC]);
+    const DecodedInstruction& ins = fetch(GPR[PC]);
+    uint32_t address = GPR[PC], code = 0;
+    bool traced = false;
+    if(HOOKS & HOOK_TRACE){
+      // a breakpoint stops in front of its instruction, which is not traced
+      traced = ins.op != Handlers::OP_BREAKPOINT;
+      code = ins.op == Handlers::OP_INVALID ? memory.readWord(GPR[PC]) : encode(ins);
+    }
+    GPR[PC] += 4;
+    if(HOOKS & HOOK_CACHE) cacheAccesses(ins);
+    ins.handler(*this, ins);
+    if(HOOKS & HOOK_PROFILE) profiler->executed(*this, ins, GPR[PC]);
+    if((HOOKS & HOOK_TRACE) && traced) tracer->record(address, code, GPR);
+    if((HOOKS & HOOK_COST) && ins.op != Handlers::OP_BREAKPOINT) cost->executed(ins, address, GPR[PC]);
+    if(++instret >= nextEvent) serviceEvents();
+  }
+}
+
+// Direct-threaded core: every oc/mod combination has a label with the handler
+// inlined into it, and each label ends by jumping straight to the label of the
+// next instruction, so dispatch is one indirect branch per instruction.
+void Emulator::runThreaded(){
+#if defined(__GNUC__)
+  void* labels[256];
+  for(void*& label: labels) label = &&op_invalid;
+  labels[0x00] = &&op_halt;
+  labels[0x10] = &&op_interrupt;
+  labels[0x20] = &&op_call;
+  labels[0x21] = &&op_callMem;
+  labels[0x30] = &&op_jmp;
+  labels[0x31] = &&op_beq;
+  labels[0x32] = &&op_bne;
+  labels[0x33] = &&op_bgt;
+  labels[0x38] = &&op_jmpMem;
+  labels[0x39] = &&op_beqMem;
+  labels[0x3A] = &&op_bneMem;
+  labels[0x3B] = &&op_bgtMem;
+  labels[0x40] = &&op_xchg;
+  labels[0x50] = &&op_add;
+  labels[0x51] = &&op_sub;
+  labels[0x52] = &&op_mul;
+  labels[0x53] = &&op_div;
+  labels[0x60] = &&op_logicNot;
+  labels[0x61] = &&op_logicAnd;
+  labels[0x62] = &&op_logicOr;
+  labels[0x63] = &&op_logicXor;
+  labels[0x70] = &&op_shl;
+  labels[0x71] = &&op_shr;
+  labels[0x80] = &&op_store;
+  labels[0x81] = &&op_storePreInc;
+  labels[0x82] = &&op_storeMem;
+  labels[0x90] = &&op_csrToGpr;
+  labels[0x91] = &&op_gprAddDisp;
+  labels[0x92] = &&op_load;
+  labels[0x93] = &&op_loadPostInc;
+  labels[0x94] = &&op_gprToCsr;
+  labels[0x95] = &&op_csrOrDisp;
+  labels[0x96] = &&op_loadCsr;
+  labels[0x97] = &&op_loadCsrPostInc;
+  labels[Handlers::OP_PUSH_PUSH] = &&op_pushPush;
+  labels[Handlers::OP_POP_POP] = &&op_popPop;
+  labels[Handlers::OP_IRET] = &&op_iret;
+  labels[Handlers::OP_POP_IRET] = &&op_popIret;
+  labels[Handlers::OP_LOAD_LOAD] = &&op_loadLoad;
+  labels[Handlers::OP_BREAKPOINT] = &&op_breakpoint;
+
+  const DecodedInstruction* ins;
+
+#define DISPATCH() \
+  ins = &fetch(GPR[PC]); \
+  GPR[PC] += 4; \
+  goto *labels[ins->op]
+
+#define OP(name) \
+  op_##name: \
+  Handlers::name(*this, *ins); \
+  if(++instret >= nextEvent){ \
+    serviceEvents(); \
+    if(!running) goto stopped; \
+  } \
+  DISPATCH();
+
+  if(running){
+    DISPATCH();
+    OP(invalid)
+    OP(interrupt)
+    OP(call)
+    OP(callMem)
+    OP(jmp)
+    OP(beq)
+    OP(bne)
+    OP(bgt)
+    OP(jmpMem)
+    OP(beqMem)
+    OP(bneMem)
+    OP(bgtMem)
+    OP(xchg)
+    OP(add)
+    OP(sub)
+    OP(mul)
+    OP(div)
+    OP(logicNot)
+    OP(logicAnd)
+    OP(logicOr)
+    OP(logicXor)
+    OP(shl)
+    OP(shr)
+    OP(store)
+    OP(storePreInc)
+    OP(storeMem)
+    OP(csrToGpr)
+    OP(gprAddDisp)
+    OP(load)
+    OP(loadPostInc)
+    OP(gprToCsr)
+    OP(csrOrDisp)
+    OP(loadCsr)
+    OP(loadCsrPostInc)
+    OP(pushPush)
+    OP(popPop)
+    OP(iret)
+    OP(popIret)
+    OP(loadLoad)
+  op_breakpoint:
+    GPR[PC] -= 4;
+    stop(StopReason::BREAKPOINT);
+    goto stopped;
+  op_halt:
+    running = false;
+  }
+stopped:
+  ;
+
+#undef OP
+#undef DISPATCH
+#else
+  runCached<0>();
+#endif
+}
+
+// Runs compiled blocks and interprets whatever the JIT leaves out. Compiled
+// code runs until the next event is due, so events are serviced at the same
+// instruction counts as in the interpreters.
+void Emulator::runJit(){
+  if(!jit) jit.reset(new Jit(*this));
+  if(!jit->available()){
+    cerr << "JIT is not available on this host, using the cached core" << endl;
+    runCached<0>();
+    return;
+  }
+  while(running){
+    uint64_t budget = nextEvent > instret ? nextEvent - instret : 0;
+    uint32_t executed = jit->run(GPR[PC], budget < INT32_MAX ? budget : INT32_MAX);
+    if(executed == 0){
+      const DecodedInstruction& ins = fetch(GPR[PC]);
+      GPR[PC] += 4;
+      ins.handler(*this, ins);
+      executed = 1;
+    }
+    instret += executed;
+    if(instret >= nextEvent) serviceEvents();
+  }
+}
+
+// Runs whatever is due at this instruction boundary: a pending fault, the
+// scheduled device events and interrupt delivery. The run loops only compare
+// instret against nextEvent, anything that needs attention sooner pulls
+// nextEvent in.
+void Emulator::serviceEvents(){
+  if(fault != Fault::NONE){
+    enterFault();
+    nextEvent = instret + 1;
+    return;
+  }
+  devices.drain();
+  bool snapshot = false, checkpoint = false;
+  Scheduler::Event event;
+  while(scheduler.pop(instret, event)){
+    switch (event.type)
+    {
+    case EventType::POLL:
+      // scripted input waits until the guest installed its handler; while
+      // replaying or re-executing, input comes from the log instead
+      if(smp != nullptr) smp->poll(*this);
+      else if(live() && (!options.headless || CSR[HANDLER] != 0) && terminal.update()){
+        logExternal(ExternalType::INPUT, terminal.term_in);
       }
-      catch(exception& e)
-      {
-        pushWord(status);
-        pushWord(pc);
-        cause = 1;
-        status = status & (~0x1);
-        pc = handler;
+      if(hasDeadline && chrono::steady_clock::now() >= deadline) stop(StopReason::TIMEOUT);
+      if(debugger != nullptr && debugger->interruptRequested()) stop(StopReason::DEBUGGER);
+      if(smp == nullptr && takeSnapshotRequest()) snapshot = true;
+      scheduler.schedule(instret + options.pollInterval, EventType::POLL);
+      break;
+    case EventType::FLUSH:
+      terminal.flush();
+      nextFlush = UINT64_MAX;
+      break;
+    case EventType::TIMER:
+      // a tim_cfg write leaves the old event behind, skip it
+      if(event.when != nextTimer) break;
+      // like terminal input, ticks before the guest installed its handler
+      // are dropped, they would send it to address 0
+      if(CSR[HANDLER] == 0){
+        if(options.timerClock == TimerClock::HOST) timer.expired();
       }
+      else if(options.timerClock == TimerClock::INSTRET){
+        timer.interrupt = true;
+      }
+      else if(live() && timer.expired()){
+        timer.interrupt = true;
+        logExternal(ExternalType::TIMER, 0);
+      }
+      scheduleTimer();
+      break;
+    case EventType::SNAPSHOT:
+      snapshot = true;
+      break;
+    case EventType::LIMIT:
+      stop(StopReason::INSTRUCTION_LIMIT);
+      break;
+    case EventType::REPLAY:
+      deliverReplayed();
+      break;
+    case EventType::CHECKPOINT:
+      checkpoint = true;
+      scheduler.schedule(instret + options.checkpointInterval, EventType::CHECKPOINT);
+      break;
+    case EventType::DMA:
+      if(dma->step()) scheduleDma();
+      break;
     }
-    printProcessorState();
   }
+  handleInterrupt();
+  nextEvent = scheduler.next();
+  if(snapshot) saveSnapshot(options.snapshotName);
+  if(checkpoint && running) takeCheckpoint();
+}
+
+// With the host clock the timer is checked once per poll interval, otherwise
+// the tick is scheduled at the exact instruction count.
+void Emulator::scheduleTimer(){
+  if(options.timerClock == TimerClock::HOST){
+    if(nextTimer == UINT64_MAX) timer.restart();
+    nextTimer = instret + options.pollInterval;
+  }
+  else{
+    nextTimer = instret + (uint64_t) timer.periodMs() * options.timerRate;
+  }
+  scheduler.schedule(nextTimer, EventType::TIMER);
+  nextEvent = min(nextEvent, nextTimer);
+}
+
+// The next chunk of the running DMA transfer.
+void Emulator::scheduleDma(){
+  scheduler.schedule(instret + Dma::INTERVAL, EventType::DMA);
+  nextEvent = min(nextEvent, instret + Dma::INTERVAL);
+}
 
 void Emulator::printMemory(){
-  for(auto& d: memory){
-    uint32_t addr = d.first;
-    uint32_t value = d.second;
+  memory.forEachPage([this](uint32_t base, const Page& page){
+    for(uint32_t offset = 0; offset < PAGE_SIZE; offset++){
+      uint32_t addr = base + offset;
+      uint32_t value = page.data[offset];
 
-    if(addr % 8 == 0){
-      cout << endl << hex << setw(4) << setfill('0') << addr << dec << setfill(' ') << ": "; 
+      if(addr % 8 == 0){
+        out << endl << hex << setw(4) << setfill('0') << addr << dec << setfill(' ') << ": "; 
+      }
+      out << hex << setw(2) << setfill('0') << value << dec << setfill(' ') << ' ';
     }
-    cout << hex << setw(2) << setfill('0') << value << dec << setfill(' ') << ' ';
-  }
-  cout << endl;
+  });
+  out << endl;
 }
 
 Instruction Emulator::readInstruction(uint32_t address){
-    Instruction ins(memory[address], memory[address+1], memory[address+2], memory[address+3]);
+    Instruction ins(memory.readWord(address));
     return ins;
   }
 
+const DecodedInstruction& Emulator::fetch(uint32_t address){
+  if(address & 3){
+    // unaligned code is decoded on every fetch
+    unaligned = Handlers::decode(memory.readWord(address));
+    if(isBreakpoint(address)) unaligned = Handlers::breakpointInstruction();
+    return unaligned;
+  }
+  DecodedInstruction& slot = memory.getPage(address).decodedPage().slots[(address & PAGE_MASK) >> 2];
+  if(__atomic_load_n(&slot.handler, __ATOMIC_ACQUIRE) == nullptr){
+    DecodedInstruction decoded = Handlers::decode(memory.readWord(address));
+    if(isBreakpoint(address)) decoded = Handlers::breakpointInstruction();
+    else if(fusion) fuse(decoded, address);
+    // the handler goes in last, other cores may be fetching from the slot
+    slot.op = decoded.op;
+    slot.regA = decoded.regA;
+    slot.regB = decoded.regB;
+    slot.regC = decoded.regC;
+    slot.disp = decoded.disp;
+    __atomic_store_n(&slot.handler, decoded.handler, __ATOMIC_RELEASE);
+  }
+  return slot;
+}
+
+// Makes the freshly decoded slot at address the head of a superinstruction
+// if it starts one. Only words in the same page and without a breakpoint
+// are fused.
+void Emulator::fuse(DecodedInstruction& slot, uint32_t address){
+  uint32_t code[FUSE_LIMIT];
+  uint32_t words = 0;
+  while(words < FUSE_LIMIT && (address & PAGE_MASK) + 4 * words < PAGE_SIZE){
+    if(words > 0 && isBreakpoint(address + 4 * words)) break;
+    code[words] = memory.readWord(address + 4 * words);
+    words++;
+  }
+  Handlers::fuse(code, words, slot);
+}
+
+// A status write zeroes nextEvent for the interrupt check, which has
+// nothing to do when no unmasked interrupt is pending. Puts nextEvent back
+// in that case and returns whether the next instruction is clear of events.
+bool Emulator::nothingDue(){
+  if(nextEvent != 0 || fault != Fault::NONE || !running) return false;
+  if(!interruptsMaksed() && ((timer.interrupt && !timerMasked()) || (terminal.interrupt && !terminalMaksed()) ||
+                             ipiPending.load(memory_order_relaxed) ||
+                             devices.interruptPending() != nullptr)){
+    return false;
+  }
+  nextEvent = scheduler.next();
+  return instret + 1 < nextEvent;
+}
+
 int Emulator::readWord(uint32_t address){
   if(address == 0xFFFFFF04){
-    return terminal.term_in;
+    if(smp != nullptr) return smp->terminalRead();
+    // the guest is consuming input, show it what it printed so far
+    terminal.flush();
+    if(profiler) profiler->terminalInput();
+    return terminal.read();
+  }
+  else if(address == 0xFFFFFF10){
+    return timer.cfg;
+  }
+  else if(address == 0xFFFFFF20){
+    return smp != nullptr ? smp->coreMask() : 1;
+  }
+  else if(Device* device = devices.find(address)){
+    return device->read(address);
   }
   else{
-    return (static_cast<int>(memory[address])     |
-    static_cast<int>(memory[address + 1]) << 8  |
-    static_cast<int>(memory[address + 2]) << 16 |
-    static_cast<int>(memory[address + 3]) << 24);
-
+    return memory.readWord(address);
   }
 }
 
 int Emulator::readByte(uint32_t address){
-  return memory[address];
+  return memory.readByte(address);
 }
 
 void Emulator::writeByte(uint32_t address, uint8_t byte){
-  memory[address] = byte;
+  memory.writeByte(address, byte);
 }
 
 void Emulator::writeWord(uint32_t address, int value){
   if (address + 3 >= 0xFFFFFFFF) {
         return;
   }
+  if(tracer) tracer->memoryWrite(address, value);
   if(address == 0xFFFFFF00){
+    if(smp != nullptr){
+      smp->terminalWrite(value);
+      return;
+    }
+    // re-executed after going back to a checkpoint, already written
+    if(instret < highWater) return;
+    if(nextFlush == UINT64_MAX){
+      nextFlush = instret + options.flushInterval;
+      scheduler.schedule(nextFlush, EventType::FLUSH);
+      nextEvent = min(nextEvent, nextFlush);
+    }
+    if(profiler) profiler->terminalOutput();
     terminal.write(value);
   }
+  else if(address == 0xFFFFFF10){
+    if(coreId != 0) return;
+    timer.configure(value);
+    if(options.timerClock == TimerClock::INSTRET) scheduleTimer();
+  }
+  else if(address == 0xFFFFFF20){
+    if(smp != nullptr) smp->interrupt(value);
+    else if(value & 1) ipiPending = true;
+    // the writing core takes its own interrupt before the next instruction
+    if((uint32_t) value >> coreId & 1) nextEvent = 0;
+  }
+  else if(Device* device = devices.find(address)){
+    bool idle = device != dma || !dma->busy();
+    device->write(address, value);
+    // a transfer this write started runs in chunks from the scheduler
+    if(idle && device == dma && dma->busy()) scheduleDma();
+    // recorded and instret timed runs must not depend on how fast the host
+    // is, they wait for the device right away
+    if(logging || options.timerClock == TimerClock::INSTRET) devices.settle();
+    // the completion interrupt comes before the next instruction
+    if(device->interrupt) nextEvent = 0;
+  }
   else{
-    memory[address]     = static_cast<uint8_t>(value);
-    memory[address + 1] = static_cast<uint8_t>(value >> 8);
-    memory[address + 2] = static_cast<uint8_t>(value >> 16);
-    memory[address + 3] = static_cast<uint8_t>(value >> 24);
+    memory.writeWord(address, value);
   }
 }
 
-int Emulator::readCSR(int reg){
-  if(reg == 0) return status;
-  if(reg == 1) return handler;
-  if(reg == 2) return cause;
-  throw InvalidCSRRegister(reg);
-}
-
-void Emulator::writeCSR(int reg, int value){
-  if(reg == 0) status = value;
-  else if(reg == 1) handler = value;
-  else if(reg == 2) cause = value;
-  else throw InvalidCSRRegister(reg);
-}
-
-int Emulator::readGPR(int reg){
-  if(reg < 0 || reg > 15) throw InvalidGPRRegister(reg);
-  if(reg == 0) return 0;
-  if(reg == 15) return pc;
-  return GPR[reg];
-}
-
-void Emulator::writeGPR(int reg, int value){
-  if(reg < 0 || reg > 15) throw InvalidGPRRegister(reg);
-  if(reg == 0) return;
-  if(reg == 15) pc = value;
-  GPR[reg] = value;
-}
-
 void Emulator::pushWord(int value){
   //if((uint32_t) readGPR(14) < 4) throw StackOverflow();
   writeGPR(14, readGPR(14) - 4);
@@ -145,7 +853,10 @@ void Emulator::pushWord(int value){
 }
 
 int Emulator::popWord(){
-  if((uint32_t) readGPR(14) > 0xFFFFFFFF - 4) throw StackOverflow();
+  if((uint32_t) readGPR(14) > 0xFFFFFFFF - 4){
+    raiseFault(Fault::STACK_OVERFLOW);
+    return 0;
+  }
   int value = readWord(readGPR(14));
   writeGPR(14, readGPR(14) + 4);
   return value;
@@ -186,7 +897,7 @@ void Emulator::executeInstruction(Instruction instruction){
     executeLoadInstruction(instruction);
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -206,17 +917,13 @@ void Emulator::executeSwapInstruction(Instruction instruction){
     writeGPR(regC, temp);
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
 
 void Emulator::executeInterruptInstruction(){
-  pushWord(status);
-  pushWord(pc);
-  cause = 4;
-  status = status & (~0x1);
-  pc = handler;
+  jumpToHandler(4);
 }
 
 void Emulator::executeAritheticInstruction(Instruction instruction){
@@ -241,12 +948,13 @@ void Emulator::executeAritheticInstruction(Instruction instruction){
   case 0x3:
     // DIV
     if(readGPR(regC) == 0){
-      throw DivisionByZero();
+      raiseFault(Fault::DIVISION_BY_ZERO);
+      break;
     }
     writeGPR(regA, readGPR(regB) / readGPR(regC));
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -275,7 +983,7 @@ void Emulator::executeLogicInstruction(Instruction instruction){
     writeGPR(regA, readGPR(regB) ^ readGPR(regC));
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -296,7 +1004,7 @@ void Emulator::executeShiftInstruction(Instruction instruction){
     writeGPR(regA, readGPR(regB) >> readGPR(regC));
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -305,7 +1013,6 @@ void Emulator::executeCallInstruction(Instruction instruction){
   int mod = instruction.mod();
   int regA = instruction.regA();
   int regB = instruction.regB();
-  int regC = instruction.regC();
   int disp = instruction.disp();
 
 
@@ -313,16 +1020,16 @@ void Emulator::executeCallInstruction(Instruction instruction){
   {
   case 0x0:
     // push pc; pc <= gpr[A] + gpr[B] + D
-    pushWord(pc);
-    pc = readGPR(regA) + readGPR(regB) + disp;
+    pushWord(GPR[PC]);
+    GPR[PC] = readGPR(regA) + readGPR(regB) + disp;
     break;
   case 0x1:
     // push pc; pc <= gpr[A] + gpr[B] + D
-    pushWord(pc);
-    pc = readWord(readGPR(regA) + readGPR(regB) + disp);
+    pushWord(GPR[PC]);
+    GPR[PC] = readWord(readGPR(regA) + readGPR(regB) + disp);
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -381,7 +1088,7 @@ void Emulator::executeJumpInstruction(Instruction instruction){
     }
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 
@@ -393,12 +1100,15 @@ void Emulator::executeLoadInstruction(Instruction instruction){
   int regB = instruction.regB();
   int regC = instruction.regC();
   int disp = instruction.disp();
+  int value;
 
   switch (mod)
   {
   case 0x0:
     // gpr[A] <= csr[B]
-    writeGPR(regA, readCSR(regB));
+    value = readCSR(regB);
+    if(fault != Fault::NONE) break;
+    writeGPR(regA, value);
     break;
   case 0x1:
     // gpr[A] <= gpr[B] + D
@@ -419,7 +1129,9 @@ void Emulator::executeLoadInstruction(Instruction instruction){
     break;
   case 0x5:
     // csr[A] <= csr[B] | D
-    writeCSR(regA, readCSR(regB) | disp);
+    value = readCSR(regB);
+    if(fault != Fault::NONE) break;
+    writeCSR(regA, value | disp);
     break;
   case 0x6:
     // csr[A] <= mem32[gpr[B] + gpr[C] + D]
@@ -428,10 +1140,11 @@ void Emulator::executeLoadInstruction(Instruction instruction){
   case 0x7:
     // csr[A] <= mem32[gpr[B]]; gpr[B] += disp
     writeCSR(regA, readWord(readGPR(regB)));
+    if(fault != Fault::NONE) break;
     writeGPR(regB, readGPR(regB) + disp);
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
@@ -461,21 +1174,21 @@ void Emulator::executeStoreInstruction(Instruction instruction){
     writeWord(readGPR(regA), readGPR(regC));
     break;
   default:
-    throw InvalidCode();
+    raiseFault(Fault::INVALID_CODE);
     break;
   }
 }
 
 bool Emulator::interruptsMaksed() {
-  return status & 0b0100;
+  return CSR[STATUS] & 0b0100;
 }
 
 bool Emulator::terminalMaksed() {
-  return status & 0b0010;
+  return CSR[STATUS] & 0b0010;
 }
 
 bool Emulator::timerMasked() {
-  return status & 0b0001;
+  return CSR[STATUS] & 0b0001;
 }
 
 void Emulator::handleInterrupt() {
@@ -486,32 +1199,70 @@ void Emulator::handleInterrupt() {
   bool interrupt = false;
   int cause = 0;
 
-  if(terminal.interrupt && !terminalMaksed()){
+  if(timer.interrupt && !timerMasked()){
+    timer.interrupt = false;
+    interrupt = true;
+    cause = 2;
+  }
+  else if(terminal.interrupt && !terminalMaksed()){
     terminal.interrupt = false;
     interrupt = true;
     cause = 3;
   }
+  else if(ipiPending.load(memory_order_relaxed) && ipiPending.exchange(false)){
+    interrupt = true;
+    cause = 5;
+  }
+  else if(Device* device = devices.interruptPending()){
+    device->interrupt = false;
+    interrupt = true;
+    cause = device->cause;
+  }
   if(interrupt){
-    pushWord(status);
-    pushWord(pc);
-    this->cause = cause;
-    status = status & (~0x1);
-    pc = handler;
+    jumpToHandler(cause);
   }
 
 }
 
+void Emulator::raiseFault(Fault fault) {
+  if(this->fault == Fault::NONE) this->fault = fault;
+  nextEvent = 0;
+}
+
+void Emulator::enterFault() {
+  fault = Fault::NONE;
+  jumpToHandler(1);
+}
+
+void Emulator::jumpToHandler(int cause) {
+  if(profiler) profiler->interrupt(cause, GPR[PC], CSR[HANDLER]);
+  if(cache){
+    cache->write(GPR[SP] - 4, 4);
+    cache->write(GPR[SP] - 8, 4);
+  }
+  pushWord(CSR[STATUS]);
+  pushWord(GPR[PC]);
+  CSR[CAUSE] = cause;
+  CSR[STATUS] = CSR[STATUS] & (~0x1);
+  GPR[PC] = CSR[HANDLER];
+}
+
 void Emulator::printProcessorState() {
-  cout << "Emulated processor executed halt instruction" << endl;
-  cout << "Emulated processor state:" << endl;
+  if(stopReason == StopReason::HALT) out << "Emulated processor executed halt instruction" << endl;
+  else out << "Emulated processor stopped: " << stopMessage(stopReason) << endl;
+  out << "Emulated processor state:" << endl;
+  printRegisters();
+}
+
+void Emulator::printRegisters() {
   for (int row = 0; row < 4; ++row) {
     for (int col = 0; col < 4; ++col) {
       int idx = row * 4 + col;
-      std::cout << "r" << idx << " = 0x" 
+      out << "r" << idx << " = 0x" 
                 << std::setw(8) << std::setfill('0') 
                 << std::hex << readGPR(idx) << dec
                 << " ";
     }
-    std::cout << std::endl;
+    out << std::endl;
     }
 }
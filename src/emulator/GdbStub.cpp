@@ -0,0 +1,381 @@
+#include "../../inc/emulator/GdbStub.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+#include <arpa/inet.h>
+#include <cstdio>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const size_t MAX_MEMORY_READ = 2048;
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+static int hexValue(char c){
+  if(c >= '0' && c <= '9') return c - '0';
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static void appendByte(string& out, uint8_t byte){
+  out += HEX_DIGITS[byte >> 4];
+  out += HEX_DIGITS[byte & 0xF];
+}
+
+static void appendHex(string& out, uint32_t value){
+  char digits[9];
+  snprintf(digits, sizeof(digits), "%x", value);
+  out += digits;
+}
+
+// Parses a hex number at pos and moves pos past it. Returns false if there
+// are no hex digits.
+static bool parseHex(const string& text, size_t& pos, uint32_t& value){
+  size_t start = pos;
+  value = 0;
+  while(pos < text.size() && hexValue(text[pos]) >= 0){
+    value = value << 4 | hexValue(text[pos]);
+    pos++;
+  }
+  return pos != start;
+}
+
+GdbStub::GdbStub(Emulator& emulator, const string& address) : emulator(emulator){
+  if(address.substr(0, 5) == "unix:"){
+    unixPath = address.substr(5);
+    sockaddr_un local = {};
+    local.sun_family = AF_UNIX;
+    if(unixPath.size() >= sizeof(local.sun_path)){
+      throw invalid_argument("Socket path too long: " + unixPath);
+    }
+    unixPath.copy(local.sun_path, unixPath.size());
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(unixPath.c_str());
+    if(listener < 0 || bind(listener, (sockaddr*) &local, sizeof(local)) < 0){
+      throw runtime_error("Failed to bind " + unixPath);
+    }
+  }
+  else{
+    size_t end = 0;
+    unsigned long port = stoul(address, &end);
+    if(end != address.size() || port > 65535){
+      throw invalid_argument("Invalid debugger port " + address);
+    }
+    sockaddr_in local = {};
+    local.sin_family = AF_INET;
+    local.sin_port = htons(port);
+    local.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse = 1;
+    if(listener >= 0) setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if(listener < 0 || bind(listener, (sockaddr*) &local, sizeof(local)) < 0){
+      throw runtime_error("Failed to bind port " + address);
+    }
+  }
+  if(listen(listener, 1) < 0){
+    throw runtime_error("Failed to listen on " + address);
+  }
+  cerr << "Waiting for debugger on " << address << endl;
+  connection = accept(listener, nullptr, nullptr);
+  if(connection < 0){
+    throw runtime_error("Failed to accept debugger connection");
+  }
+  if(unixPath.empty()){
+    int noDelay = 1;
+    setsockopt(connection, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+  }
+  emulator.debugger = this;
+}
+
+GdbStub::~GdbStub(){
+  emulator.debugger = nullptr;
+  if(connection >= 0) close(connection);
+  if(listener >= 0) close(listener);
+  if(!unixPath.empty()) unlink(unixPath.c_str());
+}
+
+bool GdbStub::serve(){
+  string packet;
+  while(!killed && !detached && readPacket(packet)){
+    string reply = handle(packet);
+    if(!killed) sendPacket(reply);
+    if(packet == "QStartNoAckMode") noAck = true;
+  }
+  return detached;
+}
+
+// Checking the socket is a system call, only every 16th poll looks.
+bool GdbStub::interruptRequested(){
+  if(++polls % 16 != 0) return false;
+  char c;
+  while(recv(connection, &c, 1, MSG_DONTWAIT) == 1){
+    if(c == 0x03) return true;
+    input += c;
+  }
+  return false;
+}
+
+bool GdbStub::receive(){
+  char chunk[4096];
+  ssize_t count = recv(connection, chunk, sizeof(chunk), 0);
+  if(count <= 0) return false;
+  input.append(chunk, count);
+  return true;
+}
+
+// Takes the next $data#checksum packet off the input, acks and interrupt
+// bytes in front of it are dropped.
+bool GdbStub::readPacket(string& packet){
+  while(true){
+    size_t start = input.find('$');
+    if(start == string::npos){
+      input.clear();
+    }
+    else{
+      size_t end = input.find('#', start);
+      if(end != string::npos && end + 2 < input.size()){
+        packet = input.substr(start + 1, end - start - 1);
+        uint8_t sum = 0;
+        for(char c: packet) sum += c;
+        int expected = hexValue(input[end + 1]) << 4 | hexValue(input[end + 2]);
+        input.erase(0, end + 3);
+        if(noAck) return true;
+        if(sum == expected){
+          send(connection, "+", 1, 0);
+          return true;
+        }
+        send(connection, "-", 1, 0);
+        continue;
+      }
+      input.erase(0, start);
+    }
+    if(!receive()) return false;
+  }
+}
+
+void GdbStub::sendPacket(const string& data){
+  uint8_t sum = 0;
+  for(char c: data) sum += c;
+  string packet = "$" + data + "#";
+  appendByte(packet, sum);
+  size_t sent = 0;
+  while(sent < packet.size()){
+    ssize_t count = send(connection, packet.data() + sent, packet.size() - sent, 0);
+    if(count <= 0) return;
+    sent += count;
+  }
+}
+
+string GdbStub::stopReply() const {
+  string reply;
+  switch (emulator.stopped())
+  {
+  case StopReason::HALT:
+    return "W00";
+  case StopReason::BREAKPOINT:
+    return swbreak ? "T05swbreak:;" : "S05";
+  case StopReason::WATCHPOINT:
+    reply = "T05watch:";
+    appendHex(reply, emulator.watchedAddress());
+    return reply + ";";
+  case StopReason::DEBUGGER:
+    return "S02";
+  default:
+    return reverseBegin ? "T05replaylog:begin;" : "S05";
+  }
+}
+
+uint32_t GdbStub::getRegister(int reg) const {
+  if(reg < 16) return emulator.GPR[reg];
+  return emulator.CSR[reg - 16];
+}
+
+void GdbStub::setRegister(int reg, uint32_t value){
+  if(reg < 16) emulator.writeGPR(reg, value);
+  else emulator.CSR[reg - 16] = value;
+}
+
+string GdbStub::readRegisters() const {
+  string reply;
+  for(int reg = 0; reg < REGISTER_COUNT; reg++){
+    uint32_t value = getRegister(reg);
+    for(int i = 0; i < 4; i++) appendByte(reply, value >> (8 * i));
+  }
+  return reply;
+}
+
+bool GdbStub::writeRegisters(const string& hex){
+  if(hex.size() < REGISTER_COUNT * 8) return false;
+  for(int reg = 0; reg < REGISTER_COUNT; reg++){
+    uint32_t value = 0;
+    for(int i = 0; i < 4; i++){
+      int high = hexValue(hex[reg * 8 + i * 2]), low = hexValue(hex[reg * 8 + i * 2 + 1]);
+      if(high < 0 || low < 0) return false;
+      value |= (uint32_t) (high << 4 | low) << (8 * i);
+    }
+    setRegister(reg, value);
+  }
+  return true;
+}
+
+// m addr,length
+string GdbStub::readMemory(const string& args) const {
+  size_t pos = 0;
+  uint32_t address, length;
+  if(!parseHex(args, pos, address) || pos >= args.size() || args[pos++] != ',' || !parseHex(args, pos, length)){
+    return "E01";
+  }
+  string reply;
+  for(uint32_t i = 0; i < length && i < MAX_MEMORY_READ; i++){
+    appendByte(reply, emulator.readByte(address + i));
+  }
+  return reply;
+}
+
+// M addr,length:bytes
+bool GdbStub::writeMemory(const string& args){
+  size_t pos = 0;
+  uint32_t address, length;
+  if(!parseHex(args, pos, address) || pos >= args.size() || args[pos++] != ',' || !parseHex(args, pos, length) ||
+     pos >= args.size() || args[pos++] != ':' || args.size() - pos < (size_t) length * 2){
+    return false;
+  }
+  for(uint32_t i = 0; i < length; i++){
+    int high = hexValue(args[pos + i * 2]), low = hexValue(args[pos + i * 2 + 1]);
+    if(high < 0 || low < 0) return false;
+    emulator.writeByte(address + i, high << 4 | low);
+  }
+  return true;
+}
+
+// Z/z type,addr,kind. Types 0 and 1 are breakpoints, 2 a write watchpoint
+// on every word the range touches. Read and access watchpoints are not
+// supported.
+string GdbStub::breakpoint(const string& packet){
+  size_t pos = 1;
+  uint32_t type, address, length;
+  if(!parseHex(packet, pos, type) || pos >= packet.size() || packet[pos++] != ',' ||
+     !parseHex(packet, pos, address) || pos >= packet.size() || packet[pos++] != ',' || !parseHex(packet, pos, length)){
+    return "E01";
+  }
+  bool insert = packet[0] == 'Z';
+  if(type == 0 || type == 1){
+    if(insert) emulator.addBreakpoint(address);
+    else emulator.removeBreakpoint(address);
+    return "OK";
+  }
+  if(type == 2){
+    for(uint32_t word = address & ~3u; word < address + max(length, 1u); word += 4){
+      if(insert) emulator.addWatch(word);
+      else emulator.removeWatch(word);
+    }
+    return "OK";
+  }
+  return "";
+}
+
+// action is c, s, bc or bs, optionally followed by a resume address.
+string GdbStub::resume(const string& action){
+  reverseBegin = false;
+  if(action[0] == 'b'){
+    if(!emulator.canReverse()) return "E01";
+    if(action[1] == 's') reverseBegin = !emulator.reverseStep();
+    else{
+      reverseBegin = !emulator.reverseContinue();
+      if(!reverseBegin) return swbreak ? "T05swbreak:;" : "S05";
+    }
+    return stopReply();
+  }
+  size_t pos = 1;
+  uint32_t address;
+  if(parseHex(action, pos, address)) emulator.GPR[Emulator::PC] = address;
+  if(action[0] == 's') emulator.step();
+  else emulator.resume();
+  emulator.terminal.flush();
+  return stopReply();
+}
+
+string GdbStub::handle(const string& packet){
+  if(packet.empty()) return "";
+  switch (packet[0])
+  {
+  case '?':
+    return stopReply();
+  case 'g':
+    return readRegisters();
+  case 'G':
+    return writeRegisters(packet.substr(1)) ? "OK" : "E01";
+  case 'p':{
+    size_t pos = 1;
+    uint32_t reg;
+    if(!parseHex(packet, pos, reg) || reg >= REGISTER_COUNT) return "E01";
+    string reply;
+    uint32_t value = getRegister(reg);
+    for(int i = 0; i < 4; i++) appendByte(reply, value >> (8 * i));
+    return reply;
+  }
+  case 'P':{
+    size_t pos = 1;
+    uint32_t reg, value = 0;
+    if(!parseHex(packet, pos, reg) || reg >= REGISTER_COUNT || pos >= packet.size() || packet[pos++] != '=' ||
+       packet.size() - pos < 8){
+      return "E01";
+    }
+    for(int i = 0; i < 4; i++){
+      int high = hexValue(packet[pos + i * 2]), low = hexValue(packet[pos + i * 2 + 1]);
+      if(high < 0 || low < 0) return "E01";
+      value |= (uint32_t) (high << 4 | low) << (8 * i);
+    }
+    setRegister(reg, value);
+    return "OK";
+  }
+  case 'm':
+    return readMemory(packet.substr(1));
+  case 'M':
+    return writeMemory(packet.substr(1)) ? "OK" : "E01";
+  case 'c':
+  case 's':
+    return resume(packet);
+  case 'b':
+    if(packet == "bc" || packet == "bs") return resume(packet);
+    return "";
+  case 'Z':
+  case 'z':
+    return breakpoint(packet);
+  case 'H':
+  case 'T':
+    return "OK";
+  case 'k':
+    killed = true;
+    emulator.stop(StopReason::DEBUGGER);
+    return "";
+  case 'D':
+    detached = true;
+    return "OK";
+  case 'q':
+    if(packet.substr(0, 10) == "qSupported"){
+      swbreak = packet.find("swbreak+") != string::npos;
+      return "PacketSize=1000;swbreak+;hwbreak+;QStartNoAckMode+;ReverseStep+;ReverseContinue+";
+    }
+    if(packet == "qAttached") return "1";
+    if(packet == "qC") return "QC1";
+    if(packet == "qfThreadInfo") return "m1";
+    if(packet == "qsThreadInfo") return "l";
+    return "";
+  case 'Q':
+    // acks stop after the reply, see serve()
+    if(packet == "QStartNoAckMode") return "OK";
+    return "";
+  case 'v':
+    if(packet == "vCont?") return "vCont;c;s";
+    if(packet.substr(0, 6) == "vCont;" && packet.size() > 6 && (packet[6] == 'c' || packet[6] == 's')){
+      return resume(string(1, packet[6]));
+    }
+    return "";
+  default:
+    return "";
+  }
+}
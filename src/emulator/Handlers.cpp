@@ -0,0 +1,144 @@
+#include "../../inc/emulator/Handlers.hpp"
+
+static array<Handler, 256> buildTable(){
+  array<Handler, 256> table;
+  table.fill(Handlers::invalid);
+
+  table[0x00] = Handlers::halt;
+  table[0x10] = Handlers::interrupt;
+
+  table[0x20] = Handlers::call;
+  table[0x21] = Handlers::callMem;
+
+  table[0x30] = Handlers::jmp;
+  table[0x31] = Handlers::beq;
+  table[0x32] = Handlers::bne;
+  table[0x33] = Handlers::bgt;
+  table[0x38] = Handlers::jmpMem;
+  table[0x39] = Handlers::beqMem;
+  table[0x3A] = Handlers::bneMem;
+  table[0x3B] = Handlers::bgtMem;
+
+  table[0x40] = Handlers::xchg;
+
+  table[0x50] = Handlers::add;
+  table[0x51] = Handlers::sub;
+  table[0x52] = Handlers::mul;
+  table[0x53] = Handlers::div;
+
+  table[0x60] = Handlers::logicNot;
+  table[0x61] = Handlers::logicAnd;
+  table[0x62] = Handlers::logicOr;
+  table[0x63] = Handlers::logicXor;
+
+  table[0x70] = Handlers::shl;
+  table[0x71] = Handlers::shr;
+
+  table[0x80] = Handlers::store;
+  table[0x81] = Handlers::storePreInc;
+  table[0x82] = Handlers::storeMem;
+
+  table[0x90] = Handlers::csrToGpr;
+  table[0x91] = Handlers::gprAddDisp;
+  table[0x92] = Handlers::load;
+  table[0x93] = Handlers::loadPostInc;
+  table[0x94] = Handlers::gprToCsr;
+  table[0x95] = Handlers::csrOrDisp;
+  table[0x96] = Handlers::loadCsr;
+  table[0x97] = Handlers::loadCsrPostInc;
+
+  return table;
+}
+
+const array<Handler, 256> Handlers::table = buildTable();
+
+// Ops that write gpr[A] without reading it.
+static bool writesOnlyA(uint8_t op){
+  switch (op >> 4)
+  {
+  case 0x5:
+  case 0x6:
+  case 0x7:
+    return true;
+  case 0x9:
+    return op <= 0x93;
+  default:
+    return false;
+  }
+}
+
+static uint8_t destination(uint32_t reg){
+  return reg != 0 ? reg : Handlers::SINK;
+}
+
+DecodedInstruction Handlers::decode(uint32_t code){
+  Instruction ins(code);
+  DecodedInstruction decoded;
+  decoded.handler = table[code >> 24];
+  decoded.op = decoded.handler == invalid ? OP_INVALID : code >> 24;
+  decoded.regA = writesOnlyA(decoded.op) ? destination(ins.regA()) : ins.regA();
+  decoded.regB = ins.regB();
+  decoded.regC = ins.regC();
+  decoded.disp = ins.disp();
+  return decoded;
+}
+
+DecodedInstruction Handlers::breakpointInstruction(){
+  DecodedInstruction decoded;
+  decoded.handler = breakpoint;
+  decoded.op = OP_BREAKPOINT;
+  return decoded;
+}
+
+// Encodings produced by the assembler: push is st pre-inc through sp by -4,
+// pop is ld post-inc through sp by 4, iret loads status from sp + 4 and
+// pops pc with sp += 8, and a pool load is followed by gpr[A] <= mem32[gpr[A]].
+static bool isPush(uint32_t code){
+  return (code & 0xFFFF0FFF) == 0x81E00FFC;
+}
+
+static bool isPop(uint32_t code){
+  return (code & 0xFF0FFFFF) == 0x930E0004 && (code >> 20 & 0xF) != 15;
+}
+
+static bool isIret(const uint32_t* code){
+  return code[0] == 0x960E0004 && code[1] == 0x93FE0008;
+}
+
+static bool isPoolLoad(uint32_t code){
+  uint32_t regA = code >> 20 & 0xF;
+  return (code & 0xFF0FF000) == 0x920F0000 && regA != 0 && regA != 15;
+}
+
+static bool isFollowUp(uint32_t code, uint32_t regA){
+  return code == (0x92000000 | regA << 20 | regA << 16);
+}
+
+uint32_t Handlers::fuse(const uint32_t* code, uint32_t words, DecodedInstruction& head){
+  if(words >= 3 && isPop(code[0]) && isIret(code + 1)){
+    head.handler = popIret;
+    head.op = OP_POP_IRET;
+    return 3;
+  }
+  if(words < 2) return 0;
+  if(isPush(code[0]) && isPush(code[1])){
+    head.handler = pushPush;
+    head.op = OP_PUSH_PUSH;
+    head.regB = code[1] >> 12 & 0xF;
+  }
+  else if(isPop(code[0]) && (code[1] & 0xFF0FFFFF) == 0x930E0004){
+    head.handler = popPop;
+    head.op = OP_POP_POP;
+    head.regB = destination(code[1] >> 20 & 0xF);
+  }
+  else if(isIret(code)){
+    head.handler = iret;
+    head.op = OP_IRET;
+  }
+  else if(isPoolLoad(code[0]) && isFollowUp(code[1], code[0] >> 20 & 0xF)){
+    head.handler = loadLoad;
+    head.op = OP_LOAD_LOAD;
+  }
+  else return 0;
+  return 2;
+}
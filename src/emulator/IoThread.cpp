@@ -0,0 +1,144 @@
+#include "../../inc/emulator/IoThread.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <fcntl.h>
+#include <ios>
+#include <poll.h>
+#include <unistd.h>
+
+bool CompletionQueue::push(function<void()>& completion){
+  size_t slot = tail.load(memory_order_relaxed);
+  if(slot - head.load(memory_order_acquire) == CAPACITY) return false;
+  slots[slot % CAPACITY] = move(completion);
+  tail.store(slot + 1, memory_order_release);
+  return true;
+}
+
+bool CompletionQueue::pop(function<void()>& completion){
+  size_t slot = head.load(memory_order_relaxed);
+  if(slot == tail.load(memory_order_acquire)) return false;
+  completion = move(slots[slot % CAPACITY]);
+  slots[slot % CAPACITY] = nullptr;
+  head.store(slot + 1, memory_order_release);
+  return true;
+}
+
+IoThread::IoThread(){
+  if(pipe(wake) != 0) throw ios_base::failure("Failed to create the I/O thread pipe");
+  fcntl(wake[0], F_SETFL, fcntl(wake[0], F_GETFL, 0) | O_NONBLOCK);
+  fcntl(wake[1], F_SETFL, fcntl(wake[1], F_GETFL, 0) | O_NONBLOCK);
+  worker = thread(&IoThread::work, this);
+}
+
+IoThread::~IoThread(){
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  char byte = 0;
+  if(write(wake[1], &byte, 1) < 0) {}
+  worker.join();
+  close(wake[0]);
+  close(wake[1]);
+}
+
+void IoThread::submit(function<void()> job){
+  {
+    lock_guard<mutex> guard(lock);
+    jobs.push_back(move(job));
+  }
+  // a full pipe already wakes the worker
+  char byte = 0;
+  if(write(wake[1], &byte, 1) < 0) {}
+}
+
+void IoThread::watch(int fd, function<void(const string&)> received){
+  {
+    lock_guard<mutex> guard(lock);
+    watches.push_back(make_shared<Watch>(Watch{fd, move(received)}));
+  }
+  char byte = 0;
+  if(write(wake[1], &byte, 1) < 0) {}
+}
+
+void IoThread::post(function<void()> completion){
+  while(!completions.push(completion)){
+    if(stopping) return;
+    this_thread::yield();
+  }
+}
+
+bool IoThread::drain(){
+  function<void()> completion;
+  bool ran = false;
+  while(completions.pop(completion)){
+    completion();
+    ran = true;
+  }
+  return ran;
+}
+
+// Keeps draining while it waits, a job may be waiting for room in the
+// completion queue.
+void IoThread::settle(){
+  unique_lock<mutex> guard(lock);
+  while(busy || !jobs.empty()){
+    guard.unlock();
+    drain();
+    guard.lock();
+    idle.wait_for(guard, chrono::milliseconds(1), [this]{return !busy && jobs.empty(); });
+  }
+  guard.unlock();
+  drain();
+}
+
+void IoThread::work(){
+  vector<pollfd> fds;
+  while(true){
+    function<void()> job;
+    {
+      lock_guard<mutex> guard(lock);
+      if(!jobs.empty()){
+        job = move(jobs.front());
+        jobs.pop_front();
+        busy = true;
+      }
+      else{
+        busy = false;
+        idle.notify_all();
+        if(stopping) return;
+      }
+    }
+    if(job){
+      job();
+      continue;
+    }
+
+    vector<shared_ptr<Watch>> watched;
+    {
+      lock_guard<mutex> guard(lock);
+      watched = watches;
+    }
+    fds.assign(1, {wake[0], POLLIN, 0});
+    for(auto& watch: watched) fds.push_back({watch->fd, POLLIN, 0});
+    if(poll(fds.data(), fds.size(), -1) < 0 && errno != EINTR) return;
+    char drained[64];
+    while(read(wake[0], drained, sizeof(drained)) > 0) {}
+    for(size_t i = 0; i < watched.size(); i++){
+      if(fds[i + 1].revents == 0 || readWatched(watched[i])) continue;
+      lock_guard<mutex> guard(lock);
+      watches.erase(find(watches.begin(), watches.end(), watched[i]));
+    }
+  }
+}
+
+// Returns false once the descriptor reached end of file or failed.
+bool IoThread::readWatched(const shared_ptr<Watch>& watch){
+  char buffer[256];
+  string data;
+  ssize_t count;
+  while((count = read(watch->fd, buffer, sizeof(buffer))) > 0) data.append(buffer, count);
+  bool open = count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+  if(!data.empty()) post([watch, data]{ watch->received(data); });
+  return open;
+}
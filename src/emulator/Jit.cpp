@@ -0,0 +1,536 @@
+#include "../../inc/emulator/Jit.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+
+namespace {
+
+const uint32_t MMIO_BASE = 0xFFFFFF00;
+
+// Host registers as used in ModRM fields. Generated code keeps the guest
+// register file in rbx, the Context in r12 and the Jit in r13.
+enum HostReg {EAX = 0, ECX = 1, EDX = 2, ESI = 6};
+
+// Condition codes for jcc.
+enum Cond {AE = 0x3, E = 0x4, NE = 0x5, S = 0x8, G = 0xF};
+
+// What a guest instruction means for the block being built.
+enum Kind {UNSUPPORTED, STRAIGHT, TRANSFER};
+
+Kind classify(uint32_t code){
+  uint8_t op = code >> 24;
+  uint8_t regA = code >> 20 & 0xF;
+  uint8_t regB = code >> 16 & 0xF;
+  uint8_t regC = code >> 12 & 0xF;
+  switch (op)
+  {
+  case 0x20:
+  case 0x30: case 0x31: case 0x32: case 0x33:
+  case 0x38: case 0x39: case 0x3A: case 0x3B:
+    return TRANSFER;
+  case 0x40:
+    return (regB == 15 || regC == 15) ? UNSUPPORTED : STRAIGHT;
+  case 0x50: case 0x51: case 0x52: case 0x53:
+  case 0x60: case 0x61: case 0x62: case 0x63:
+  case 0x70: case 0x71:
+  case 0x91: case 0x92:
+    return regA == 15 ? TRANSFER : STRAIGHT;
+  case 0x80: case 0x82:
+    return STRAIGHT;
+  case 0x81:
+    return regA == 15 ? UNSUPPORTED : STRAIGHT;
+  case 0x93:
+    if(regB == 15) return UNSUPPORTED;
+    return regA == 15 ? TRANSFER : STRAIGHT;
+  default:
+    // halt, int, call through memory and csr accesses stay in the interpreter
+    return UNSUPPORTED;
+  }
+}
+
+struct Emitter {
+  uint8_t* p;
+
+  void byte(uint8_t b) {*p++ = b; }
+  void bytes(initializer_list<uint8_t> bs) {for(uint8_t b: bs) byte(b); }
+  void u32(uint32_t v) {memcpy(p, &v, 4); p += 4; }
+  void u64(uint64_t v) {memcpy(p, &v, 8); p += 8; }
+
+  static void patch(uint8_t* rel, uint8_t* target) {
+    int32_t offset = target - (rel + 4);
+    memcpy(rel, &offset, 4);
+  }
+
+  // Both return the address of the rel32 field so it can be patched later.
+  uint8_t* jcc(Cond cond) {bytes({0x0F, uint8_t(0x80 | cond)}); uint8_t* rel = p; u32(0); return rel; }
+  uint8_t* jmp() {byte(0xE9); uint8_t* rel = p; u32(0); return rel; }
+  void jmpTo(uint8_t* target) {patch(jmp(), target); }
+
+  // reg <= guest register, r0 reads as zero and r15 as the pc after the
+  // instruction, which is what readGPR returns while it executes.
+  void loadGuest(HostReg reg, int guest, uint32_t nextPc) {
+    if(guest == 0) bytes({0x31, uint8_t(0xC0 | reg << 3 | reg)});
+    else if(guest == 15) {byte(0xB8 + reg); u32(nextPc); }
+    else bytes({0x8B, uint8_t(0x43 | reg << 3), uint8_t(4 * guest)});
+  }
+  void storeGuest(HostReg reg, int guest) {
+    if(guest == 0) return;
+    bytes({0x89, uint8_t(0x43 | reg << 3), uint8_t(4 * guest)});
+  }
+
+  void addEaxImm(int32_t imm) {if(imm != 0) {byte(0x05); u32(imm); } }
+  void addEcxImm(int32_t imm) {if(imm != 0) {bytes({0x81, 0xC1}); u32(imm); } }
+  void addEaxEcx() {bytes({0x01, 0xC8}); }
+  void cmpEaxEcx() {bytes({0x39, 0xC8}); }
+  void cmpEaxImm(uint32_t imm) {byte(0x3D); u32(imm); }
+  void movEdxImm(uint32_t imm) {byte(0xBA); u32(imm); }
+  void movEaxImm(uint32_t imm) {byte(0xB8); u32(imm); }
+  void xorEdxEdx() {bytes({0x31, 0xD2}); }
+  void testEaxEax() {bytes({0x85, 0xC0}); }
+
+  // budget += imm
+  void addBudget(int32_t imm) {if(imm != 0) {bytes({0x41, 0x81, 0x04, 0x24}); u32(imm); } }
+  // budget -= imm
+  void subBudget(int32_t imm) {bytes({0x41, 0x81, 0x2C, 0x24}); u32(imm); }
+
+  // helper(jit, esi = eax, edx)
+  void callHelper(void* helper) {
+    bytes({0x89, 0xC6});             // mov esi, eax
+    bytes({0x4C, 0x89, 0xEF});       // mov rdi, r13
+    bytes({0x48, 0xB8}); u64(reinterpret_cast<uint64_t>(helper)); // mov rax, helper
+    bytes({0xFF, 0xD0});             // call rax
+  }
+};
+
+}
+
+Jit::Jit(Emulator& emulator) : emulator(emulator){
+  void* memory = mmap(nullptr, CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(memory == MAP_FAILED) return;
+  buffer = static_cast<uint8_t*>(memory);
+
+  Emitter e{buffer};
+  enter = reinterpret_cast<void (*)(int*, Context*, Jit*, uint8_t*)>(e.p);
+  e.bytes({0x53});                   // push rbx
+  e.bytes({0x41, 0x54});             // push r12
+  e.bytes({0x41, 0x55});             // push r13
+  e.bytes({0x48, 0x89, 0xFB});       // mov rbx, rdi
+  e.bytes({0x49, 0x89, 0xF4});       // mov r12, rsi
+  e.bytes({0x49, 0x89, 0xD5});       // mov r13, rdx
+  e.bytes({0xFF, 0xE1});             // jmp rcx
+
+  // eax = next pc, rdx = patchable exit site or null
+  exitStub = e.p;
+  e.bytes({0x41, 0x89, 0x44, 0x24, offsetof(Context, nextPc)});   // mov [r12 + nextPc], eax
+  e.bytes({0x49, 0x89, 0x54, 0x24, offsetof(Context, lastExit)}); // mov [r12 + lastExit], rdx
+  e.bytes({0x41, 0x5D});             // pop r13
+  e.bytes({0x41, 0x5C});             // pop r12
+  e.bytes({0x5B});                   // pop rbx
+  e.bytes({0xC3});                   // ret
+
+  used = codeStart = e.p - buffer;
+}
+
+Jit::~Jit(){
+  if(buffer != nullptr) munmap(buffer, CACHE_SIZE);
+}
+
+uint32_t Jit::loadHelper(Jit* jit, uint32_t address){
+  return jit->emulator.memory.readWord(address);
+}
+
+uint32_t Jit::storeHelper(Jit* jit, uint32_t address, uint32_t value){
+  jit->invalidated = false;
+  jit->emulator.memory.writeWord(address, value);
+  // a watched word changed, leave so the stop is seen right away
+  return jit->invalidated || jit->emulator.nextEvent == 0;
+}
+
+uint32_t Jit::run(int& pc, int32_t budget){
+  Block* block = lookup(pc);
+  if(block == nullptr || static_cast<int32_t>(block->length) > budget) return 0;
+
+  context.budget = budget;
+  context.lastExit = nullptr;
+  enter(emulator.GPR, &context, this, block->entry);
+  pc = context.nextPc;
+
+  if(context.lastExit != nullptr){
+    uint8_t* site = context.lastExit;
+    uint32_t before = flushes;
+    Block* next = lookup(context.nextPc);
+    // compiling the target may have flushed the cache, site is gone then
+    if(next != nullptr && flushes == before){
+      chain(site, next);
+    }
+  }
+  return budget - context.budget;
+}
+
+Jit::Block* Jit::lookup(uint32_t pc){
+  auto it = blocks.find(pc);
+  if(it != blocks.end()) return it->second;
+  Block* block = (pc & 3) ? nullptr : compile(pc);
+  blocks[pc] = block;
+  // the word at pc decides, hook its page so overwriting it lets it compile
+  if(block == nullptr){
+    Page* page = emulator.memory.findPage(pc);
+    if(page != nullptr) page->hooked = true;
+  }
+  return block;
+}
+
+void Jit::flush(){
+  allBlocks.clear();
+  blocks.clear();
+  pageBlocks.clear();
+  used = codeStart;
+  flushes++;
+}
+
+void Jit::chain(uint8_t* site, Block* target){
+  site[0] = 0xE9;
+  Emitter::patch(site + 1, target->entry);
+  target->incoming.push_back(site);
+}
+
+void Jit::unchain(uint8_t* site, uint32_t target){
+  site[0] = 0xB8;
+  memcpy(site + 1, &target, 4);
+}
+
+void Jit::kill(Block* block){
+  block->live = false;
+  auto it = blocks.find(block->start);
+  if(it != blocks.end() && it->second == block) blocks.erase(it);
+  for(uint8_t* site: block->incoming){
+    unchain(site, block->start);
+  }
+  block->incoming.clear();
+  invalidated = true;
+}
+
+void Jit::codeWritten(uint32_t address, uint32_t size){
+  auto page = pageBlocks.find(address >> PAGE_BITS);
+  if(page != pageBlocks.end()){
+    vector<Block*>& list = page->second;
+    for(Block* block: list){
+      if(block->live && address < block->end && address + size > block->start){
+        kill(block);
+      }
+    }
+    list.erase(remove_if(list.begin(), list.end(), [](Block* b){return !b->live; }), list.end());
+  }
+  // forget that the written words could not be compiled, they may be code now
+  for(uint32_t word = address & ~3u; word < address + size; word += 4){
+    auto it = blocks.find(word);
+    if(it != blocks.end() && it->second == nullptr) blocks.erase(it);
+  }
+}
+
+Jit::Block* Jit::compile(uint32_t start){
+  Memory& memory = emulator.memory;
+
+  vector<uint32_t> codes;
+  uint32_t pc = start;
+  bool transfer = false;
+  bool interpretNext = false;
+  while(codes.size() < BLOCK_LIMIT){
+    uint32_t code = memory.readWord(pc);
+    Kind kind = classify(code);
+    // breakpoints are left to the interpreter
+    if(kind == UNSUPPORTED || emulator.isBreakpoint(pc)){
+      interpretNext = true;
+      break;
+    }
+    codes.push_back(code);
+    pc += 4;
+    if(kind == TRANSFER){
+      transfer = true;
+      break;
+    }
+    if((pc & PAGE_MASK) == 0) break;
+  }
+  if(codes.empty()) return nullptr;
+
+  if(CACHE_SIZE - used < 64 * 1024) flush();
+
+  const int32_t length = codes.size();
+  Emitter e{buffer + used};
+  uint8_t* entry = e.p;
+
+  // Out-of-line code, emitted after the block body.
+  vector<pair<uint8_t*, function<void()>>> cold;
+
+  // Leaves to the interpreter, instruction `index` has not executed yet.
+  auto interpretAt = [&](uint8_t* rel, int index, uint32_t insPc){
+    cold.push_back({rel, [&e, length, index, insPc, this](){
+      e.addBudget(length - index);
+      e.movEaxImm(insPc);
+      e.xorEdxEdx();
+      e.jmpTo(exitStub);
+    }});
+  };
+  // Exit with a known target, patched into a direct jump once chained.
+  auto exitTo = [&](uint32_t target){
+    uint8_t* site = e.p;
+    e.movEaxImm(target);
+    e.bytes({0x48, 0xBA}); e.u64(reinterpret_cast<uint64_t>(site)); // mov rdx, site
+    e.jmpTo(exitStub);
+  };
+  // Exit to the pc held in eax.
+  auto exitDynamic = [&](){
+    e.xorEdxEdx();
+    e.jmpTo(exitStub);
+  };
+  // Memory accesses at or above the MMIO base are done by the interpreter.
+  auto checkMmio = [&](int index, uint32_t insPc){
+    e.cmpEaxImm(MMIO_BASE);
+    interpretAt(e.jcc(AE), index, insPc);
+  };
+  // A store that hit compiled code ends the block, it may have been our own.
+  auto checkStore = [&](int index, uint32_t nextPc){
+    e.testEaxEax();
+    uint8_t* rel = e.jcc(NE);
+    cold.push_back({rel, [&e, length, index, nextPc, this](){
+      e.addBudget(length - index - 1);
+      e.movEaxImm(nextPc);
+      e.xorEdxEdx();
+      e.jmpTo(exitStub);
+    }});
+  };
+  // eax <= gpr[A] + gpr[B] + D, or an exit straight to it if it is known now.
+  auto jumpTarget = [&](int regA, int regB, int disp, uint32_t nextPc, bool chainable){
+    bool constA = regA == 0 || regA == 15;
+    bool constB = regB == 0 || regB == 15;
+    if(constA && constB){
+      uint32_t target = (regA == 15 ? nextPc : 0) + (regB == 15 ? nextPc : 0) + disp;
+      if(chainable) exitTo(target);
+      else {e.movEaxImm(target); exitDynamic(); }
+    }
+    else{
+      e.loadGuest(EAX, regA, nextPc);
+      if(regB != 0){
+        e.loadGuest(ECX, regB, nextPc);
+        e.addEaxEcx();
+      }
+      e.addEaxImm(disp);
+      exitDynamic();
+    }
+  };
+
+  // Refuse to start when the block does not fit into the budget.
+  e.subBudget(length);
+  uint8_t* refuse = e.jcc(S);
+  cold.push_back({refuse, [&e, length, start, this](){
+    e.addBudget(length);
+    e.movEaxImm(start);
+    e.xorEdxEdx();
+    e.jmpTo(exitStub);
+  }});
+
+  for(int i = 0; i < length; i++){
+    Instruction ins(codes[i]);
+    uint8_t op = codes[i] >> 24;
+    int regA = ins.regA(), regB = ins.regB(), regC = ins.regC(), disp = ins.disp();
+    uint32_t insPc = start + 4 * i;
+    uint32_t nextPc = insPc + 4;
+
+    switch (op)
+    {
+    case 0x20:
+      // push pc; pc <= gpr[A] + gpr[B] + D
+      e.loadGuest(EAX, 14, nextPc);
+      e.addEaxImm(-4);
+      checkMmio(i, insPc);
+      e.storeGuest(EAX, 14);
+      e.movEdxImm(nextPc);
+      e.callHelper(reinterpret_cast<void*>(storeHelper));
+      e.testEaxEax();
+      {
+        uint8_t* rel = e.jcc(NE);
+        jumpTarget(regA, regB, disp, nextPc, true);
+        Emitter::patch(rel, e.p);
+        jumpTarget(regA, regB, disp, nextPc, false);
+      }
+      break;
+    case 0x30:
+      jumpTarget(regA, 0, disp, nextPc, true);
+      break;
+    case 0x31: case 0x32: case 0x33:
+    case 0x39: case 0x3A: case 0x3B:
+      {
+        e.loadGuest(EAX, regB, nextPc);
+        e.loadGuest(ECX, regC, nextPc);
+        e.cmpEaxEcx();
+        Cond cond = (op & 0x7) == 1 ? E : (op & 0x7) == 2 ? NE : G;
+        uint8_t* taken = e.jcc(cond);
+        exitTo(nextPc);
+        Emitter::patch(taken, e.p);
+        if(op & 0x8){
+          e.loadGuest(EAX, regA, nextPc);
+          e.addEaxImm(disp);
+          checkMmio(i, insPc);
+          e.callHelper(reinterpret_cast<void*>(loadHelper));
+          exitDynamic();
+        }
+        else{
+          jumpTarget(regA, 0, disp, nextPc, true);
+        }
+      }
+      break;
+    case 0x38:
+      // pc <= mem32[gpr[A] + D]
+      e.loadGuest(EAX, regA, nextPc);
+      e.addEaxImm(disp);
+      checkMmio(i, insPc);
+      e.callHelper(reinterpret_cast<void*>(loadHelper));
+      exitDynamic();
+      break;
+    case 0x40:
+      e.loadGuest(EAX, regB, nextPc);
+      e.loadGuest(ECX, regC, nextPc);
+      e.storeGuest(ECX, regB);
+      e.storeGuest(EAX, regC);
+      break;
+    case 0x50: case 0x51: case 0x52: case 0x53:
+    case 0x60: case 0x61: case 0x62: case 0x63:
+    case 0x70: case 0x71:
+      e.loadGuest(EAX, regB, nextPc);
+      if(op != 0x60) e.loadGuest(ECX, regC, nextPc);
+      switch (op)
+      {
+      case 0x50: e.bytes({0x01, 0xC8}); break;         // add eax, ecx
+      case 0x51: e.bytes({0x29, 0xC8}); break;         // sub eax, ecx
+      case 0x52: e.bytes({0x0F, 0xAF, 0xC1}); break;   // imul eax, ecx
+      case 0x53:
+        // zero and -1 divisors are left to the interpreter
+        e.bytes({0x85, 0xC9});                         // test ecx, ecx
+        interpretAt(e.jcc(E), i, insPc);
+        e.bytes({0x83, 0xF9, 0xFF});                   // cmp ecx, -1
+        interpretAt(e.jcc(E), i, insPc);
+        e.bytes({0x99, 0xF7, 0xF9});                   // cdq; idiv ecx
+        break;
+      case 0x60: e.bytes({0xF7, 0xD0}); break;         // not eax
+      case 0x61: e.bytes({0x21, 0xC8}); break;         // and eax, ecx
+      case 0x62: e.bytes({0x09, 0xC8}); break;         // or eax, ecx
+      case 0x63: e.bytes({0x31, 0xC8}); break;         // xor eax, ecx
+      case 0x70: e.bytes({0xD3, 0xE0}); break;         // shl eax, cl
+      case 0x71: e.bytes({0xD3, 0xF8}); break;         // sar eax, cl
+      }
+      if(regA == 15) exitDynamic();
+      else e.storeGuest(EAX, regA);
+      break;
+    case 0x80:
+      // mem32[gpr[A] + gpr[B] + D] <= gpr[C]
+      e.loadGuest(EAX, regA, nextPc);
+      e.loadGuest(ECX, regB, nextPc);
+      e.addEaxEcx();
+      e.addEaxImm(disp);
+      checkMmio(i, insPc);
+      e.loadGuest(EDX, regC, nextPc);
+      e.callHelper(reinterpret_cast<void*>(storeHelper));
+      checkStore(i, nextPc);
+      break;
+    case 0x81:
+      // gpr[A] <= gpr[A] + D; mem32[gpr[A]] <= gpr[C]
+      if(regA == 0){
+        e.movEaxImm(0);
+      }
+      else{
+        e.loadGuest(EAX, regA, nextPc);
+        e.addEaxImm(disp);
+      }
+      checkMmio(i, insPc);
+      e.storeGuest(EAX, regA);
+      e.loadGuest(EDX, regC, nextPc);
+      e.callHelper(reinterpret_cast<void*>(storeHelper));
+      checkStore(i, nextPc);
+      break;
+    case 0x82:
+      // mem32[mem32[gpr[A] + gpr[B] + D]] <= gpr[C]
+      e.loadGuest(EAX, regA, nextPc);
+      e.loadGuest(ECX, regB, nextPc);
+      e.addEaxEcx();
+      e.addEaxImm(disp);
+      checkMmio(i, insPc);
+      e.callHelper(reinterpret_cast<void*>(loadHelper));
+      checkMmio(i, insPc);
+      e.loadGuest(EDX, regC, nextPc);
+      e.callHelper(reinterpret_cast<void*>(storeHelper));
+      checkStore(i, nextPc);
+      break;
+    case 0x91:
+      // gpr[A] <= gpr[B] + D
+      e.loadGuest(EAX, regB, nextPc);
+      e.addEaxImm(disp);
+      if(regA == 15) exitDynamic();
+      else e.storeGuest(EAX, regA);
+      break;
+    case 0x92:
+      // gpr[A] <= mem32[gpr[B] + gpr[C] + D]
+      e.loadGuest(EAX, regB, nextPc);
+      e.loadGuest(ECX, regC, nextPc);
+      e.addEaxEcx();
+      e.addEaxImm(disp);
+      checkMmio(i, insPc);
+      e.callHelper(reinterpret_cast<void*>(loadHelper));
+      if(regA == 15) exitDynamic();
+      else e.storeGuest(EAX, regA);
+      break;
+    case 0x93:
+      // gpr[A] <= mem32[gpr[B]]; gpr[B] <= gpr[B] + D
+      e.loadGuest(EAX, regB, nextPc);
+      checkMmio(i, insPc);
+      e.callHelper(reinterpret_cast<void*>(loadHelper));
+      if(regA != 15) e.storeGuest(EAX, regA);
+      if(regB != 0){
+        e.loadGuest(ECX, regB, nextPc);
+        e.addEcxImm(disp);
+        e.storeGuest(ECX, regB);
+      }
+      if(regA == 15) exitDynamic();
+      break;
+    }
+  }
+
+  if(!transfer){
+    if(interpretNext){
+      e.movEaxImm(pc);
+      exitDynamic();
+    }
+    else{
+      exitTo(pc);
+    }
+  }
+
+  for(auto& stub: cold){
+    Emitter::patch(stub.first, e.p);
+    stub.second();
+  }
+
+  used = e.p - buffer;
+
+  Block* block = new Block();
+  block->start = start;
+  block->end = pc;
+  block->length = length;
+  block->entry = entry;
+  allBlocks.emplace_back(block);
+  pageBlocks[start >> PAGE_BITS].push_back(block);
+  memory.getPage(start).hooked = true;
+  return block;
+}
+
+#else
+
+Jit::Jit(Emulator& emulator) : emulator(emulator){}
+Jit::~Jit(){}
+uint32_t Jit::run(int& pc, int32_t budget) {return 0; }
+void Jit::codeWritten(uint32_t address, uint32_t size){}
+
+#endif
@@ -1,14 +1,56 @@
+#include "../../inc/emulator/Batch.hpp"
+#include "../../inc/emulator/Bench.hpp"
 #include "../../inc/emulator/Emulator.hpp"
 
 int main(int argc, char const *argv[]){
-  if(argc != 2){
-    cerr << "Usage: ./emulator [inputFileName]";
+  Options options;
+  vector<string> inputFiles;
+  for(int i = 1; i < argc; i++){
+    string arg = argv[i];
+    if(arg[0] == '-'){
+      try
+      {
+        options.processArgument(arg);
+      }
+      catch(const std::exception& e)
+      {
+        cerr << e.what() << endl;
+        return 1;
+      }
+    }
+    else{
+      inputFiles.push_back(arg);
+    }
+  }
+  if(inputFiles.empty()){
+    cerr << "Usage: ./emulator [-core=switch|cached|threaded|jit] [-poll=N] [-flush=N] [-unbuffered] [-timer=host|instret] [-timer-rate=N] [-profile[=name]] [-trace=file] [-cache[=name]] [-cache-l1i|l1d|l2=size:ways:line[:lru|fifo|random]] [-cache-latency=l2:memory] [-cost[=latencies]] [-snapshot=file] [-snapshot-at=N] [-restore=file] [-record=file] [-replay=file] [-checkpoint=N] [-headless] [-input=text|-input-file=file] [-max-instret=N] [-timeout=ms] [-break=addr|symbol] [-watch=addr|symbol] [-gdb=port|unix:path] [-disk=file] [-cores=N] [inputFileName]" << endl;
+    cerr << "       ./emulator -batch [-jobs=N] [options] inputFileName..." << endl;
+    cerr << "       ./emulator -bench [-bench-runs=N] [-baseline=report.json] [-bench-tolerance=percent] [options] inputFileName..." << endl;
+    cerr << "       -cores=N cannot be combined with -gdb, -profile, -trace, -cache, -cost, -record, -replay, -checkpoint," << endl;
+    cerr << "       -snapshot-at, -restore, -break, -watch or -disk, and runs -core=jit on the cached core" << endl;
+    return 1;
+  }
+  if(options.batch){
+    return runBatch(inputFiles, options);
+  }
+  if(options.bench){
+    return runBenchmark(inputFiles, options);
+  }
+  if(inputFiles.size() > 1){
+    cerr << "More than one input file needs -batch or -bench" << endl;
     return 1;
   }
-  string inputFile = argv[1];
 
-  Emulator emulator(inputFile);
-  emulator.start();
+  try
+  {
+    Emulator emulator(inputFiles.front(), options);
+    emulator.start();
+  }
+  catch(const std::exception& e)
+  {
+    cerr << e.what() << endl;
+    return 1;
+  }
 
 
 }
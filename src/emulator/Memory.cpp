@@ -0,0 +1,166 @@
+#include "../../inc/emulator/Memory.hpp"
+#include <algorithm>
+#include <sys/mman.h>
+
+Memory::~Memory(){
+  for(uint32_t t = 0; t < TABLE_SIZE; t++){
+    if(tables[t] == nullptr) continue;
+    for(uint32_t p = 0; p < TABLE_SIZE; p++){
+      if(!tables[t][p].mapped) delete[] tables[t][p].data;
+      delete tables[t][p].decoded;
+    }
+    delete[] tables[t];
+  }
+  for(uint8_t* data: retired) delete[] data;
+  for(auto& mapping: mappings){
+    munmap(mapping.first, mapping.second.size);
+  }
+}
+
+// Cores can touch a new page at the same time, the lock makes sure it is
+// allocated once. Readers find tables and pages without it.
+Page& Memory::allocatePage(uint32_t address){
+  lock_guard<mutex> lock(allocation);
+  Page* table = tables[tableIndex(address)];
+  if(table == nullptr){
+    table = new Page[TABLE_SIZE];
+    __atomic_store_n(&tables[tableIndex(address)], table, __ATOMIC_RELEASE);
+  }
+  Page& page = table[pageIndex(address)];
+  if(page.data == nullptr) __atomic_store_n(&page.data, new uint8_t[PAGE_SIZE](), __ATOMIC_RELEASE);
+  return page;
+}
+
+// Under the allocation lock like allocatePage, a core may be faulting in
+// the same page.
+void Memory::mapPage(uint32_t address, uint8_t* data){
+  lock_guard<mutex> lock(allocation);
+  Page* table = tables[tableIndex(address)];
+  if(table == nullptr){
+    table = new Page[TABLE_SIZE];
+    __atomic_store_n(&tables[tableIndex(address)], table, __ATOMIC_RELEASE);
+  }
+  Page& page = table[pageIndex(address)];
+  uint8_t* old = page.data;
+  bool owned = old != nullptr && !page.mapped;
+  bool wasMapped = page.mapped;
+  page.mapped = true;
+  __atomic_store_n(&page.data, data, __ATOMIC_RELEASE);
+  auto mapping = findMapping(data);
+  if(mapping != mappings.end()) mapping->second.pages++;
+  if(owned && shared) retired.push_back(old);
+  else if(owned) delete[] old;
+  else if(wasMapped) release(old);
+  page.invalidate(0, PAGE_SIZE);
+}
+
+// The region data lies in, or end().
+map<uint8_t*, Memory::Mapping>::iterator Memory::findMapping(uint8_t* data){
+  auto mapping = mappings.upper_bound(data);
+  if(mapping == mappings.begin()) return mappings.end();
+  --mapping;
+  return data < mapping->first + mapping->second.size ? mapping : mappings.end();
+}
+
+// Called under the allocation lock when a page stops using data. Other
+// cores may still be reading a shared page, its region stays until the
+// memory goes.
+void Memory::release(uint8_t* data){
+  auto mapping = findMapping(data);
+  if(mapping == mappings.end() || --mapping->second.pages != 0 || shared) return;
+  munmap(mapping->first, mapping->second.size);
+  mappings.erase(mapping);
+}
+
+void Memory::dropMapping(void* base){
+  lock_guard<mutex> lock(allocation);
+  auto mapping = mappings.find(static_cast<uint8_t*>(base));
+  if(mapping == mappings.end() || mapping->second.pages != 0) return;
+  munmap(mapping->first, mapping->second.size);
+  mappings.erase(mapping);
+}
+
+uint32_t Memory::readWordSlow(uint32_t address) const {
+  return static_cast<uint32_t>(readByte(address))           |
+         static_cast<uint32_t>(readByte(address + 1)) << 8  |
+         static_cast<uint32_t>(readByte(address + 2)) << 16 |
+         static_cast<uint32_t>(readByte(address + 3)) << 24;
+}
+
+void Memory::writeWordSlow(uint32_t address, uint32_t value){
+  writeByte(address,     static_cast<uint8_t>(value));
+  writeByte(address + 1, static_cast<uint8_t>(value >> 8));
+  writeByte(address + 2, static_cast<uint8_t>(value >> 16));
+  writeByte(address + 3, static_cast<uint8_t>(value >> 24));
+}
+
+void Memory::written(Page& page, uint32_t address, uint32_t size){
+  page.dirty = true;
+  page.invalidate(address & PAGE_MASK, size);
+  if(page.hooked) writeHook(address, size);
+}
+
+void Memory::detachPage(uint32_t address){
+  lock_guard<mutex> lock(allocation);
+  Page* page = findPage(address);
+  if(page == nullptr || !page->mapped) return;
+  uint8_t* old = page->data;
+  uint8_t* copy = new uint8_t[PAGE_SIZE];
+  memcpy(copy, old, PAGE_SIZE);
+  page->mapped = false;
+  __atomic_store_n(&page->data, copy, __ATOMIC_RELEASE);
+  release(old);
+}
+
+// Chunks end at the next page boundary of either range. An overlapping copy
+// to a higher address goes from the end down.
+void Memory::copy(uint32_t destination, uint32_t source, uint32_t length){
+  bool backward = destination > source && (uint64_t) source + length > destination;
+  uint64_t done = 0;
+  while(done < length){
+    uint32_t remaining = length - done;
+    uint32_t from, to, chunk;
+    if(backward){
+      uint32_t fromEnd = source + remaining, toEnd = destination + remaining;
+      chunk = min(remaining, min(((fromEnd - 1) & PAGE_MASK) + 1, ((toEnd - 1) & PAGE_MASK) + 1));
+      from = fromEnd - chunk;
+      to = toEnd - chunk;
+    }
+    else{
+      from = source + done;
+      to = destination + done;
+      chunk = min(remaining, min(PAGE_SIZE - (from & PAGE_MASK), PAGE_SIZE - (to & PAGE_MASK)));
+    }
+    Page* fromPage = findPage(from);
+    if(fromPage == nullptr) fill(to, 0, chunk);
+    else{
+      Page& toPage = getPage(to);
+      memmove(toPage.data + (to & PAGE_MASK), fromPage->data + (from & PAGE_MASK), chunk);
+      written(toPage, to, chunk);
+    }
+    done += chunk;
+  }
+}
+
+void Memory::fill(uint32_t destination, uint8_t value, uint32_t length){
+  uint64_t done = 0;
+  while(done < length){
+    uint32_t address = destination + done;
+    uint32_t chunk = min<uint64_t>(length - done, PAGE_SIZE - (address & PAGE_MASK));
+    done += chunk;
+    if(value == 0 && findPage(address) == nullptr) continue;
+    Page& page = getPage(address);
+    memset(page.data + (address & PAGE_MASK), value, chunk);
+    written(page, address, chunk);
+  }
+}
+
+void Memory::clearDirty(){
+  for(uint32_t t = 0; t < TABLE_SIZE; t++){
+    if(tables[t] == nullptr) continue;
+    for(uint32_t p = 0; p < TABLE_SIZE; p++){
+      tables[t][p].dirty = false;
+      tables[t][p].checkpointed = false;
+    }
+  }
+}
@@ -0,0 +1,233 @@
+#include "../../inc/emulator/Profiler.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static const uint32_t REPORT_ENTRIES = 32;
+
+static const char* opName(uint8_t op){
+  switch (op)
+  {
+  case 0x00: return "halt";
+  case 0x10: return "int";
+  case 0x20: return "call";
+  case 0x21: return "call [mem]";
+  case 0x30: return "jmp";
+  case 0x31: return "beq";
+  case 0x32: return "bne";
+  case 0x33: return "bgt";
+  case 0x38: return "jmp [mem]";
+  case 0x39: return "beq [mem]";
+  case 0x3A: return "bne [mem]";
+  case 0x3B: return "bgt [mem]";
+  case 0x40: return "xchg";
+  case 0x50: return "add";
+  case 0x51: return "sub";
+  case 0x52: return "mul";
+  case 0x53: return "div";
+  case 0x60: return "not";
+  case 0x61: return "and";
+  case 0x62: return "or";
+  case 0x63: return "xor";
+  case 0x70: return "shl";
+  case 0x71: return "shr";
+  case 0x80: return "st";
+  case 0x81: return "st pre-inc";
+  case 0x82: return "st [mem]";
+  case 0x90: return "csrrd";
+  case 0x91: return "ld gpr+disp";
+  case 0x92: return "ld";
+  case 0x93: return "ld post-inc";
+  case 0x94: return "csrwr";
+  case 0x95: return "csr or";
+  case 0x96: return "csr ld";
+  case 0x97: return "csr ld post-inc";
+  case 0xFF: return "breakpoint";
+  default: return "invalid";
+  }
+}
+
+static string hexAddress(uint32_t address){
+  ostringstream out;
+  out << "0x" << hex << setw(8) << setfill('0') << address;
+  return out.str();
+}
+
+// symbol+offset, or the bare address without a symbol
+string Profiler::label(uint32_t address) const {
+  uint32_t offset;
+  const string* name = functions.symbol(address, offset);
+  if(name == nullptr) return hexAddress(address);
+  if(offset == 0) return *name;
+  ostringstream out;
+  out << *name << "+0x" << hex << offset;
+  return out.str();
+}
+
+Profiler::Profiler(uint32_t entry, const map<string, uint32_t>& symbols) : functions(symbols){
+  nodes.push_back({0, label(entry), 0});
+  stack.push_back({0, 0});
+}
+
+void Profiler::executed(Emulator& e, const DecodedInstruction& ins, uint32_t pc){
+  ops[ins.op]++;
+  // int and interrupt entry are counted in interrupt()
+  switch (ins.op)
+  {
+  case 0x20:
+    writes++;
+    push(pc, current + 4, 0);
+    break;
+  case 0x21:
+    reads++;
+    writes++;
+    push(pc, current + 4, 0);
+    break;
+  case 0x38:
+    reads++;
+    break;
+  case 0x39:
+    if(e.readGPR(ins.regB) == e.readGPR(ins.regC)) reads++;
+    break;
+  case 0x3A:
+    if(e.readGPR(ins.regB) != e.readGPR(ins.regC)) reads++;
+    break;
+  case 0x3B:
+    if(e.readGPR(ins.regB) > e.readGPR(ins.regC)) reads++;
+    break;
+  case 0x80:
+  case 0x81:
+    writes++;
+    break;
+  case 0x82:
+    reads++;
+    writes++;
+    break;
+  case 0x93:
+    reads++;
+    if(ins.regA == 15){
+      // ret/iret: drop the frame we are returning out of
+      for(size_t i = stack.size() - 1; i > 0; i--){
+        if(stack[i].returnAddress == pc){
+          stack.resize(i);
+          break;
+        }
+      }
+    }
+    break;
+  case 0x92:
+  case 0x96:
+  case 0x97:
+    reads++;
+    break;
+  }
+}
+
+void Profiler::interrupt(int cause, uint32_t returnPc, uint32_t handler){
+  if(cause >= 0 && cause < 8) interrupts[cause]++;
+  writes += 2;
+  push(handler, returnPc, cause);
+}
+
+void Profiler::push(uint32_t function, uint32_t returnAddress, int cause){
+  if(stack.size() >= MAX_DEPTH) return;
+  uint32_t parent = stack.back().node;
+  uint64_t key = (uint64_t) parent << 40 | (uint64_t) cause << 32 | function;
+  auto it = children.find(key);
+  uint32_t node;
+  if(it != children.end()){
+    node = it->second;
+  }
+  else{
+    node = nodes.size();
+    string name = label(function);
+    if(cause != 0) name = "interrupt" + to_string(cause) + "@" + name;
+    nodes.push_back({parent, name, 0});
+    children[key] = node;
+  }
+  stack.push_back({returnAddress, node});
+}
+
+string Profiler::path(uint32_t node) const {
+  string result = nodes[node].name;
+  while(node != 0){
+    node = nodes[node].parent;
+    result = nodes[node].name + ";" + result;
+  }
+  return result;
+}
+
+void Profiler::writeReport(const string& base, uint64_t instret) const {
+  ofstream report(base + ".txt");
+  auto percent = [instret](uint64_t count){
+    return instret == 0 ? 0.0 : 100.0 * count / instret;
+  };
+  report << fixed << setprecision(2);
+  report << "Instructions executed: " << instret << endl;
+  report << "Memory reads: " << reads << endl;
+  report << "Memory writes: " << writes << endl;
+  report << "Terminal writes: " << terminalWrites << endl;
+  report << "Terminal reads: " << terminalReads << endl;
+  report << "Interrupts: fault " << interrupts[1] << ", timer " << interrupts[2]
+         << ", terminal " << interrupts[3] << ", software " << interrupts[4]
+         << ", ipi " << interrupts[5] << ", dma " << interrupts[6] << ", disk " << interrupts[7] << endl;
+
+  vector<pair<uint64_t, uint32_t>> sorted;
+  for(uint32_t op = 0; op < 256; op++){
+    if(ops[op] != 0) sorted.push_back({ops[op], op});
+  }
+  sort(sorted.rbegin(), sorted.rend());
+  report << endl << "Instructions by oc/mod:" << endl;
+  for(auto& entry: sorted){
+    report << "  " << hex << setw(2) << setfill('0') << entry.second << dec << setfill(' ')
+           << "  " << left << setw(16) << opName(entry.second) << right
+           << setw(14) << entry.first << setw(8) << percent(entry.first) << "%" << endl;
+  }
+
+  sorted.clear();
+  for(auto& page: pages){
+    for(uint32_t slot = 0; slot < 1024; slot++){
+      uint64_t count = page.second->counts[slot];
+      if(count != 0) sorted.push_back({count, page.first + slot * 4});
+    }
+  }
+  sort(sorted.rbegin(), sorted.rend());
+  report << endl << "Hottest instructions:" << endl;
+  for(size_t i = 0; i < sorted.size() && i < REPORT_ENTRIES; i++){
+    report << "  " << hexAddress(sorted[i].second) << "  " << left << setw(24) << label(sorted[i].second) << right
+           << setw(14) << sorted[i].first << setw(8) << percent(sorted[i].first) << "%" << endl;
+  }
+
+  map<string, uint64_t> counts;
+  for(auto& entry: sorted){
+    uint32_t offset;
+    const string* name = functions.symbol(entry.second, offset);
+    counts[name != nullptr ? *name : "[no symbol]"] += entry.first;
+  }
+  vector<pair<uint64_t, string>> byFunction;
+  for(auto& count: counts) byFunction.push_back({count.second, count.first});
+  sort(byFunction.rbegin(), byFunction.rend());
+  report << endl << "Hottest functions:" << endl;
+  for(size_t i = 0; i < byFunction.size() && i < REPORT_ENTRIES; i++){
+    report << "  " << left << setw(34) << byFunction[i].second << right
+           << setw(14) << byFunction[i].first << setw(8) << percent(byFunction[i].first) << "%" << endl;
+  }
+
+  sorted.clear();
+  for(auto& block: blockEntries){
+    sorted.push_back({block.second, block.first});
+  }
+  sort(sorted.rbegin(), sorted.rend());
+  report << endl << "Most entered basic blocks:" << endl;
+  for(size_t i = 0; i < sorted.size() && i < REPORT_ENTRIES; i++){
+    report << "  " << hexAddress(sorted[i].second) << "  " << left << setw(24) << label(sorted[i].second) << right
+           << setw(14) << sorted[i].first << endl;
+  }
+
+  ofstream folded(base + ".folded");
+  for(uint32_t node = 0; node < nodes.size(); node++){
+    if(nodes[node].count != 0) folded << path(node) << " " << nodes[node].count << endl;
+  }
+}
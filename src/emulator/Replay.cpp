@@ -0,0 +1,183 @@
+#include "../../inc/emulator/Emulator.hpp"
+#include "../../inc/emulator/Jit.hpp"
+#include <fstream>
+#include <set>
+
+void Emulator::logExternal(ExternalType type, uint32_t value){
+  if(!logging) return;
+  eventLog.push_back({instret, static_cast<uint32_t>(type), value});
+  replayPosition = eventLog.size();
+}
+
+// Delivers the logged events due at this instruction the way the live
+// devices did.
+void Emulator::deliverReplayed(){
+  while(replaying() && eventLog[replayPosition].instret <= instret){
+    const ExternalEvent& event = eventLog[replayPosition++];
+    if(event.type == static_cast<uint32_t>(ExternalType::INPUT)){
+      terminal.term_in = event.value;
+      terminal.interrupt = true;
+    }
+    else{
+      timer.interrupt = true;
+    }
+  }
+  scheduleReplay();
+}
+
+void Emulator::scheduleReplay(){
+  if(!replaying()) return;
+  scheduler.schedule(eventLog[replayPosition].instret, EventType::REPLAY);
+  nextEvent = min(nextEvent, eventLog[replayPosition].instret);
+}
+
+void Emulator::loadEventLog(const string& filename){
+  ifstream inFile(filename, ios::binary);
+  EventLogHeader header;
+  if(!inFile.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != EVENT_LOG_MAGIC){
+    throw ios_base::failure("Invalid event log " + filename);
+  }
+  eventLog.resize(header.eventCount);
+  if(!inFile.read(reinterpret_cast<char*>(eventLog.data()), eventLog.size() * sizeof(ExternalEvent))){
+    throw ios_base::failure("Event log " + filename + " is truncated");
+  }
+  options.timerClock = static_cast<TimerClock>(header.timerClock);
+  options.timerRate = header.timerRate;
+  replayPosition = 0;
+}
+
+void Emulator::saveEventLog(const string& filename) const {
+  ofstream outFile(filename, ios::binary);
+  if(!outFile){
+    cerr << "Failed to open event log " << filename << endl;
+    return;
+  }
+  EventLogHeader header = {};
+  header.magic = EVENT_LOG_MAGIC;
+  header.timerClock = static_cast<uint32_t>(options.timerClock);
+  header.timerRate = options.timerRate;
+  header.eventCount = eventLog.size();
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outFile.write(reinterpret_cast<const char*>(eventLog.data()), eventLog.size() * sizeof(ExternalEvent));
+}
+
+// Taken between instructions like snapshots. Only pages written since the
+// previous checkpoint are copied.
+void Emulator::takeCheckpoint(){
+  devices.settle();
+  checkpoints.emplace_back();
+  Checkpoint& checkpoint = checkpoints.back();
+  captureState(checkpoint.state);
+  checkpoint.events = scheduler.pending();
+  checkpoint.logPosition = replayPosition;
+  bool first = checkpoints.size() == 1;
+  memory.forEachPage([&checkpoint, first](uint32_t base, Page& page){
+    if(!first && !page.dirty) return;
+    checkpoint.pages[base].assign(page.data, page.data + PAGE_SIZE);
+    if(page.dirty){
+      page.dirty = false;
+      page.checkpointed = true;
+    }
+  });
+}
+
+// Puts memory and state back to checkpoints[index] and drops the later
+// checkpoints, re-executing recreates them.
+void Emulator::restoreCheckpoint(size_t index){
+  highWater = max(highWater, instret);
+
+  set<uint32_t> written;
+  for(size_t i = index + 1; i < checkpoints.size(); i++){
+    for(auto& page: checkpoints[i].pages) written.insert(page.first);
+  }
+  memory.forEachPage([&written](uint32_t base, Page& page){
+    if(page.dirty) written.insert(base);
+  });
+  for(uint32_t base: written){
+    const uint8_t* content = nullptr;
+    for(size_t i = index + 1; i-- > 0 && content == nullptr;){
+      auto it = checkpoints[i].pages.find(base);
+      if(it != checkpoints[i].pages.end()) content = it->second.data();
+    }
+    Page& page = memory.getPage(base);
+    if(content != nullptr) memcpy(page.data, content, PAGE_SIZE);
+    else memset(page.data, 0, PAGE_SIZE);
+    page.invalidate(0, PAGE_SIZE);
+    if(jit != nullptr) jit->codeWritten(base, PAGE_SIZE);
+    page.dirty = false;
+    page.checkpointed = true;
+  }
+  for(Watch& watch: watches){
+    watch.value = memory.readWord(watch.address);
+  }
+
+  checkpoints.resize(index + 1);
+  const Checkpoint& checkpoint = checkpoints.back();
+  applyState(checkpoint.state);
+  scheduler = Scheduler();
+  for(auto& event: checkpoint.events){
+    if(event.type != EventType::REPLAY) scheduler.schedule(event.when, event.type);
+  }
+  nextEvent = scheduler.next();
+  replayPosition = checkpoint.logPosition;
+  scheduleReplay();
+  fault = Fault::NONE;
+  running = true;
+  stopReason = StopReason::NONE;
+}
+
+// Re-executes on the reference core until instret reaches target. With
+// lastBreak set it notes the last instruction that sits on a breakpoint.
+// Watched words and the timeout already fired the first time round.
+void Emulator::runForward(uint64_t target, uint64_t* lastBreak){
+  vector<Watch> savedWatches;
+  swap(savedWatches, watches);
+  bool savedDeadline = hasDeadline;
+  hasDeadline = false;
+  while(running && instret < target){
+    if(lastBreak != nullptr && isBreakpoint(GPR[PC])) *lastBreak = instret;
+    Instruction ins = readInstruction(GPR[PC]);
+    GPR[PC] += 4;
+    executeInstruction(ins);
+    if(++instret >= nextEvent) serviceEvents();
+  }
+  hasDeadline = savedDeadline;
+  swap(savedWatches, watches);
+  for(Watch& watch: watches){
+    watch.value = memory.readWord(watch.address);
+  }
+}
+
+bool Emulator::reverseStep(){
+  if(checkpoints.empty() || instret <= checkpoints[0].state.instret) return false;
+  uint64_t target = instret - 1;
+  size_t index = checkpoints.size() - 1;
+  while(checkpoints[index].state.instret > target) index--;
+  restoreCheckpoint(index);
+  runForward(target, nullptr);
+  return true;
+}
+
+bool Emulator::reverseContinue(){
+  if(checkpoints.empty() || instret <= checkpoints[0].state.instret) return false;
+  uint64_t end = instret;
+  size_t index = checkpoints.size() - 1;
+  while(checkpoints[index].state.instret >= end) index--;
+  // search one checkpoint interval at a time, latest first
+  while(!breakpoints.empty()){
+    uint64_t start = checkpoints[index].state.instret;
+    uint64_t hit = UINT64_MAX;
+    restoreCheckpoint(index);
+    runForward(end, &hit);
+    if(hit != UINT64_MAX){
+      restoreCheckpoint(index);
+      runForward(hit, nullptr);
+      return true;
+    }
+    if(index == 0) break;
+    index--;
+    end = start;
+  }
+  restoreCheckpoint(0);
+  return false;
+}
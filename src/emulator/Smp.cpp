@@ -0,0 +1,87 @@
+#include "../../inc/emulator/Smp.hpp"
+#include "../../inc/emulator/Emulator.hpp"
+
+Smp::Smp(Emulator& boot) : boot(boot){
+  const Options& options = boot.options;
+  if(options.cores > MAX_CORES){
+    throw invalid_argument("At most " + to_string(MAX_CORES) + " cores are supported");
+  }
+  // all of these follow a single core through its instruction stream
+  if(!options.gdb.empty() || options.profile || !options.traceName.empty() || options.cache || options.cost ||
+     !options.recordName.empty() || !options.replayName.empty() || options.checkpointInterval != 0 ||
+     options.snapshotAt != UINT64_MAX || !options.restoreName.empty() ||
+     !options.breakpoints.empty() || !options.watchpoints.empty()){
+    throw invalid_argument("-cores cannot be combined with -gdb, -profile, -trace, -cache, -cost, -record, -replay, "
+                           "-checkpoint, -snapshot-at, -restore, -break or -watch");
+  }
+  // reads swap the pages of memory the other cores are running on
+  if(!options.disk.empty()){
+    throw invalid_argument("-cores cannot be combined with -disk");
+  }
+  if(options.core == Core::JIT){
+    cerr << "The JIT does not support -cores, using the cached core" << endl;
+    boot.options.core = Core::CACHED;
+  }
+  boot.smp = this;
+  boot.memory.shared = true;
+  for(uint32_t id = 1; id < options.cores; id++){
+    cores.emplace_back(new Emulator(boot, id));
+  }
+}
+
+Smp::~Smp(){
+  halted = true;
+  for(thread& worker: threads) worker.join();
+  boot.smp = nullptr;
+  boot.memory.shared = false;
+}
+
+void Smp::run(){
+  for(auto& core: cores){
+    Emulator* emulator = core.get();
+    threads.emplace_back([emulator]{ emulator->run(); });
+  }
+  boot.run();
+  halted = true;
+  for(thread& worker: threads) worker.join();
+  threads.clear();
+}
+
+void Smp::printState(){
+  for(auto& core: cores){
+    boot.out << "Core " << core->coreId << " state:" << endl;
+    core->printRegisters();
+  }
+}
+
+void Smp::interrupt(uint32_t mask){
+  if(mask & 1) boot.ipiPending = true;
+  for(auto& core: cores){
+    if(mask >> core->coreId & 1) core->ipiPending = true;
+  }
+}
+
+uint32_t Smp::terminalRead(){
+  lock_guard<mutex> lock(devices);
+  boot.terminal.flush();
+  return boot.terminal.read();
+}
+
+void Smp::terminalWrite(uint32_t value){
+  lock_guard<mutex> lock(devices);
+  boot.terminal.write(value);
+}
+
+// Output of all cores goes out at core 0's polls, the other cores check
+// whether the machine stopped.
+void Smp::poll(Emulator& core){
+  if(&core != &boot){
+    if(halted) core.stop(StopReason::HALT);
+    return;
+  }
+  lock_guard<mutex> lock(devices);
+  // scripted input would otherwise arrive before the guest installed its
+  // handler
+  if(!boot.options.headless || boot.CSR[Emulator::HANDLER] != 0) boot.terminal.update();
+  boot.terminal.flush();
+}
@@ -0,0 +1,180 @@
+#include "../../inc/emulator/Emulator.hpp"
+#include "../../inc/emulator/Snapshot.hpp"
+#include <atomic>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Counts signals, lock-free so the handler may touch it.
+static atomic<unsigned> snapshotSignals{0};
+
+static void requestSnapshot(int){
+  snapshotSignals.fetch_add(1, memory_order_relaxed);
+}
+
+void Emulator::installSnapshotSignal(){
+  snapshotRequests = snapshotSignals.load(memory_order_relaxed);
+  signal(SIGUSR1, requestSnapshot);
+}
+
+bool Emulator::takeSnapshotRequest(){
+  unsigned signals = snapshotSignals.load(memory_order_relaxed);
+  if(signals == snapshotRequests) return false;
+  snapshotRequests = signals;
+  return true;
+}
+
+// Processor and device state, shared by snapshots and checkpoints.
+void Emulator::captureState(SnapshotHeader& state) const {
+  memcpy(state.gpr, GPR, sizeof(state.gpr));
+  state.pc = GPR[PC];
+  state.status = CSR[STATUS];
+  state.handler = CSR[HANDLER];
+  state.cause = CSR[CAUSE];
+  state.instret = instret;
+  state.nextFlush = nextFlush;
+  state.nextTimer = nextTimer;
+  state.timerCfg = timer.cfg;
+  state.termIn = terminal.term_in;
+  state.timerInterrupt = timer.interrupt;
+  state.terminalInterrupt = terminal.interrupt;
+  state.inputPosition = terminal.inputOffset();
+  state.inputConsumed = terminal.inputConsumed();
+  state.ipiPending = ipiPending.load(memory_order_relaxed);
+  state.dmaSource = dma->source;
+  state.dmaDestination = dma->destination;
+  state.dmaLength = dma->length;
+  state.dmaControl = dma->control;
+  state.dmaInterrupt = dma->interrupt;
+  if(disk){
+    state.diskSector = disk->sector;
+    state.diskBuffer = disk->buffer;
+    state.diskCount = disk->count;
+    state.diskControl = disk->control;
+    state.diskInterrupt = disk->interrupt;
+  }
+}
+
+void Emulator::applyState(const SnapshotHeader& state){
+  memcpy(GPR, state.gpr, sizeof(state.gpr));
+  GPR[PC] = state.pc;
+  CSR[STATUS] = state.status;
+  CSR[HANDLER] = state.handler;
+  CSR[CAUSE] = state.cause;
+  instret = state.instret;
+  nextFlush = state.nextFlush;
+  nextTimer = state.nextTimer;
+  timer.configure(state.timerCfg);
+  timer.interrupt = state.timerInterrupt;
+  terminal.term_in = state.termIn;
+  terminal.interrupt = state.terminalInterrupt;
+  ipiPending = state.ipiPending;
+  dma->source = state.dmaSource;
+  dma->destination = state.dmaDestination;
+  dma->length = state.dmaLength;
+  dma->control = state.dmaControl;
+  dma->interrupt = state.dmaInterrupt;
+  if(disk){
+    disk->sector = state.diskSector;
+    disk->buffer = state.diskBuffer;
+    disk->count = state.diskCount;
+    disk->control = state.diskControl;
+    disk->interrupt = state.diskInterrupt;
+  }
+}
+
+// Called between instructions, after events and interrupts are serviced, so
+// a restored run continues with exactly the next instruction.
+void Emulator::saveSnapshot(const string& filename){
+  terminal.flush();
+  // transfers in flight finish first, the snapshot has no room for them
+  devices.settle();
+
+  vector<Scheduler::Event> events = scheduler.pending();
+  vector<uint32_t> pages;
+  memory.forEachPage([&pages](uint32_t base, const Page& page){
+    if(page.dirty || page.checkpointed) pages.push_back(base);
+  });
+
+  SnapshotHeader header = {};
+  header.magic = SNAPSHOT_MAGIC;
+  header.eventCount = events.size();
+  header.pageCount = pages.size();
+  size_t tableEnd = sizeof(header) + events.size() * sizeof(SnapshotEvent) + pages.size() * sizeof(uint32_t);
+  header.pageOffset = (tableEnd + PAGE_MASK) & ~PAGE_MASK;
+  captureState(header);
+
+  ofstream outFile(filename, ios::binary);
+  if(!outFile){
+    cerr << "Failed to open snapshot file " << filename << endl;
+    return;
+  }
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for(auto& event: events){
+    SnapshotEvent saved = {event.when, static_cast<uint32_t>(event.type)};
+    outFile.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+  }
+  outFile.write(reinterpret_cast<const char*>(pages.data()), pages.size() * sizeof(uint32_t));
+  string padding(header.pageOffset - tableEnd, '\0');
+  outFile.write(padding.data(), padding.size());
+  for(uint32_t base: pages){
+    outFile.write(reinterpret_cast<const char*>(memory.findPage(base)->data), PAGE_SIZE);
+  }
+}
+
+// Replaces the state of a freshly loaded program with the snapshot. Saved
+// pages are mapped privately from the file.
+void Emulator::restoreSnapshot(const string& filename){
+  int fd = open(filename.c_str(), O_RDONLY);
+  if(fd < 0){
+    throw ios_base::failure("Failed to open snapshot " + filename);
+  }
+  struct stat st;
+  if(fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof(SnapshotHeader)){
+    close(fd);
+    throw ios_base::failure("Snapshot too short");
+  }
+  size_t size = st.st_size;
+  void* image = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(image == MAP_FAILED){
+    throw ios_base::failure("Failed to map snapshot");
+  }
+  memory.addMapping(image, size);
+  uint8_t* bytes = static_cast<uint8_t*>(image);
+
+  SnapshotHeader header;
+  memcpy(&header, bytes, sizeof(header));
+  size_t pageTable = sizeof(header) + header.eventCount * sizeof(SnapshotEvent);
+  if(header.magic != SNAPSHOT_MAGIC ||
+     pageTable + header.pageCount * sizeof(uint32_t) > header.pageOffset ||
+     header.pageOffset + (size_t) header.pageCount * PAGE_SIZE > size){
+    throw ios_base::failure("Invalid snapshot " + filename);
+  }
+
+  applyState(header);
+  // checkpoints leave this out, re-executed input comes from the log
+  terminal.resumeInput(header.inputPosition, header.inputConsumed);
+
+  for(uint32_t i = 0; i < header.eventCount; i++){
+    SnapshotEvent event;
+    memcpy(&event, bytes + sizeof(header) + i * sizeof(event), sizeof(event));
+    EventType type = static_cast<EventType>(event.type);
+    // these follow the options of the restoring run, start() adds them
+    if(type == EventType::REPLAY || type == EventType::CHECKPOINT ||
+       type == EventType::LIMIT || type == EventType::SNAPSHOT) continue;
+    scheduler.schedule(event.when, type);
+  }
+  for(uint32_t i = 0; i < header.pageCount; i++){
+    uint32_t base;
+    memcpy(&base, bytes + pageTable + i * sizeof(base), sizeof(base));
+    memory.mapPage(base, bytes + header.pageOffset + (size_t) i * PAGE_SIZE);
+    // still differs from the program image
+    memory.getPage(base).dirty = true;
+  }
+  nextEvent = scheduler.next();
+}
@@ -1,4 +1,5 @@
 #include <fcntl.h>
+#include <algorithm>
 #include <iostream>
 #include <unistd.h>
 #include <stdexcept>
@@ -6,9 +7,7 @@
 
 using namespace std;
 
-Terminal::Terminal(){
-  interrupt = false;
-  term_in = 0;
+void Terminal::openConsole(){
   int flags = fcntl(STDIN_FILENO, F_GETFL, 0);
   fcntl(STDIN_FILENO, F_SETFL, flags | O_NONBLOCK);
   if (tcgetattr(STDIN_FILENO, &t) < 0) {
@@ -19,21 +18,67 @@ Terminal::Terminal(){
   if (tcsetattr(STDIN_FILENO, TCSANOW, &t) < 0) {
       throw std::runtime_error("Failed to execute tcsetattr during terminal initialization.");
   }
+  console = true;
 }
 
-void Terminal::update() {
-  char rd;
-  if (read(STDIN_FILENO, &rd, 1) >= 0) {
-    term_in = rd;
+void Terminal::setInput(const string& input){
+  headless = true;
+  this->input = input;
+  inputPosition = 0;
+}
+
+void Terminal::received(const string& data){
+  // drop what the guest already got
+  input.erase(0, inputPosition);
+  inputPosition = 0;
+  input += data;
+}
+
+// A restored run is given the same input again, it picks up where the
+// saved one was.
+void Terminal::resumeInput(size_t offset, bool consumed){
+  if(!headless) return;
+  inputPosition = min(offset, input.size());
+  this->consumed = consumed;
+}
+
+bool Terminal::update() {
+  // interactively the next byte replaces the last one like on a real port
+  if((consumed || !headless) && inputPosition < input.size()){
+    term_in = static_cast<uint8_t>(input[inputPosition++]);
+    consumed = false;
     interrupt = true;
+    return true;
   }
+  return false;
+}
+
+uint32_t Terminal::read() {
+  consumed = true;
+  return term_in;
 }
 
 void Terminal::write(uint32_t data) {
-    cout << char(data & 0xFF) << std::flush;
+  char c = data & 0xFF;
+  if(!buffered){
+    *out << c << std::flush;
+    return;
+  }
+  output += c;
+  if(c == '\n' || output.size() >= OUTPUT_BUFFER_SIZE){
+    flush();
+  }
+}
+
+void Terminal::flush() {
+  if(output.empty()) return;
+  out->write(output.data(), output.size()) << std::flush;
+  output.clear();
 }
 
 Terminal::~Terminal() {
+    flush();
+    if(!console) return;
     t.c_lflag = oldFlags;
     tcsetattr(STDIN_FILENO, TCSADRAIN, &t);
-}
\ No newline at end of file
+}
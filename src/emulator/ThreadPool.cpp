@@ -0,0 +1,83 @@
+#include "../../inc/emulator/ThreadPool.hpp"
+
+ThreadPool::ThreadPool(unsigned threads){
+  if(threads == 0) threads = 1;
+  for(unsigned i = 0; i < threads; i++){
+    queues.emplace_back(new Queue());
+  }
+  for(unsigned i = 0; i < threads; i++){
+    workers.emplace_back(&ThreadPool::work, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool(){
+  {
+    lock_guard<mutex> guard(stateLock);
+    stopping = true;
+  }
+  taskAvailable.notify_all();
+  for(thread& worker: workers){
+    worker.join();
+  }
+}
+
+void ThreadPool::submit(function<void()> task){
+  Queue& queue = *queues[nextQueue++ % queues.size()];
+  {
+    // counted first so a worker that takes the task right away can't
+    // decrement below zero
+    lock_guard<mutex> guard(stateLock);
+    queued++;
+    pending++;
+  }
+  {
+    lock_guard<mutex> guard(queue.lock);
+    queue.tasks.push_back(move(task));
+  }
+  taskAvailable.notify_one();
+}
+
+void ThreadPool::wait(){
+  unique_lock<mutex> guard(stateLock);
+  allDone.wait(guard, [this]{return pending == 0; });
+}
+
+bool ThreadPool::take(unsigned index, function<void()>& task){
+  {
+    Queue& own = *queues[index];
+    lock_guard<mutex> guard(own.lock);
+    if(!own.tasks.empty()){
+      task = move(own.tasks.back());
+      own.tasks.pop_back();
+      queued--;
+      return true;
+    }
+  }
+  for(unsigned i = 1; i < queues.size(); i++){
+    Queue& victim = *queues[(index + i) % queues.size()];
+    lock_guard<mutex> guard(victim.lock);
+    if(!victim.tasks.empty()){
+      task = move(victim.tasks.front());
+      victim.tasks.pop_front();
+      queued--;
+      return true;
+    }
+  }
+  return false;
+}
+
+void ThreadPool::work(unsigned index){
+  function<void()> task;
+  while(true){
+    if(take(index, task)){
+      task();
+      task = nullptr;
+      lock_guard<mutex> guard(stateLock);
+      if(--pending == 0) allDone.notify_all();
+      continue;
+    }
+    unique_lock<mutex> guard(stateLock);
+    taskAvailable.wait(guard, [this]{return stopping || queued > 0; });
+    if(stopping && queued == 0) return;
+  }
+}
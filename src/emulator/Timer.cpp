@@ -0,0 +1,23 @@
+#include "../../inc/emulator/Timer.hpp"
+
+using namespace std;
+
+const uint32_t Timer::PERIODS_MS[8] = {500, 1000, 1500, 2000, 5000, 10000, 30000, 60000};
+
+void Timer::configure(uint32_t value) {
+  cfg = value;
+  restart();
+}
+
+void Timer::restart() {
+  deadline = chrono::steady_clock::now() + chrono::milliseconds(periodMs());
+}
+
+bool Timer::expired() {
+  auto now = chrono::steady_clock::now();
+  if(now < deadline) return false;
+  deadline += chrono::milliseconds(periodMs());
+  // don't try to catch up on ticks missed while the host was busy
+  if(deadline <= now) deadline = now + chrono::milliseconds(periodMs());
+  return true;
+}
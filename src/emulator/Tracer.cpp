@@ -0,0 +1,71 @@
+#include "../../inc/emulator/Tracer.hpp"
+#include <stdexcept>
+
+Tracer::Tracer(const string& filename, const int* gpr, uint32_t pc){
+  file = fopen(filename.c_str(), "wb");
+  if(file == nullptr){
+    throw runtime_error("Failed to open trace file " + filename);
+  }
+  TraceHeader header;
+  header.magic = TRACE_MAGIC;
+  header.pc = pc;
+  memcpy(header.gpr, gpr, sizeof(header.gpr));
+  fwrite(&header, sizeof(header), 1, file);
+
+  memcpy(shadow, gpr, sizeof(shadow));
+  memset(codes, 0, sizeof(codes));
+  // the first record stores its pc as a delta from the entry point
+  lastPc = pc - 4;
+  chunks.resize(CHUNK_COUNT, vector<uint8_t>(CHUNK_SIZE));
+  cursor = chunks[0].data();
+  limit = cursor + CHUNK_SIZE;
+  writer = thread(&Tracer::writeChunks, this);
+}
+
+Tracer::~Tracer(){
+  submit();
+  {
+    lock_guard<mutex> guard(lock);
+    stopping = true;
+  }
+  chunkReady.notify_one();
+  writer.join();
+  fclose(file);
+}
+
+uint8_t* Tracer::memoryWrites(uint8_t* p){
+  p = putVarint(p, writeCount);
+  for(uint32_t i = 0; i < writeCount; i++){
+    p = putVarint(p, zigzag(writes[i].address - lastWrite));
+    p = putVarint(p, writes[i].value);
+    lastWrite = writes[i].address;
+  }
+  writeCount = 0;
+  return p;
+}
+
+// Hands the chunk being filled to the writer and waits for the next one to
+// be free.
+void Tracer::submit(){
+  unique_lock<mutex> guard(lock);
+  lengths[filling % CHUNK_COUNT] = cursor - chunks[filling % CHUNK_COUNT].data();
+  filling++;
+  chunkReady.notify_one();
+  chunkFree.wait(guard, [this]{return filling - written < CHUNK_COUNT; });
+  cursor = chunks[filling % CHUNK_COUNT].data();
+  limit = cursor + CHUNK_SIZE;
+}
+
+void Tracer::writeChunks(){
+  unique_lock<mutex> guard(lock);
+  while(true){
+    chunkReady.wait(guard, [this]{return stopping || written < filling; });
+    if(written == filling) return;
+    size_t index = written % CHUNK_COUNT;
+    guard.unlock();
+    fwrite(chunks[index].data(), 1, lengths[index], file);
+    guard.lock();
+    written++;
+    chunkFree.notify_one();
+  }
+}
@@ -47,7 +47,7 @@ void Linker::processHEX(){
   solveRelocations();
   generateHex();
 
-  writeToFile(outputFileName, memoryData);
+  writeToFile(outputFileName, memoryData, symbolValues);
 
   string textFileName = outputFileName.substr(0, outputFileName.size() - 4) + ".txt";
   ofstream ofs(textFileName);
@@ -420,24 +420,53 @@ void writeToFile(const std::string& filename, const std::vector<Section_>& secti
     }
 
 
-void writeToFile(const std::string& filename, const map<uint32_t, uint8_t> memory) {
+void writeToFile(const std::string& filename, const map<uint32_t, uint8_t> memory, const map<string, uint32_t>& symbols) {
   std::ofstream outFile(filename, std::ios::binary);
   if (!outFile) {
       throw std::ios_base::failure("Failed to open file for writing");
   }
 
-  // Write the size of the map
-  uint32_t mapSize = static_cast<uint32_t>(memory.size());
-  outFile.write(reinterpret_cast<const char*>(&mapSize), sizeof(mapSize));
-  
-  // Write each key-value pair
+  // Split the image into runs of consecutive addresses
+  vector<SegmentHeader> segments;
   for (const auto& pair : memory) {
-      outFile.write(reinterpret_cast<const char*>(&pair.first), sizeof(pair.first));
-      outFile.write(reinterpret_cast<const char*>(&pair.second), sizeof(pair.second));
+      if (segments.empty() || pair.first != segments.back().address + segments.back().size) {
+          segments.push_back({pair.first, 0, 0});
+      }
+      segments.back().size++;
+  }
+
+  // A payload that covers a whole page starts where its address lies inside
+  // a page, so the emulator can map that page straight out of the file. The
+  // rest are copied anyway and are packed without padding.
+  uint32_t payloadStart = sizeof(ExecutableHeader) + segments.size() * sizeof(SegmentHeader);
+  uint32_t position = payloadStart;
+  for (auto& segment : segments) {
+      uint64_t firstPage = ((uint64_t) segment.address + EXECUTABLE_PAGE_SIZE - 1) & ~(uint64_t) (EXECUTABLE_PAGE_SIZE - 1);
+      if (firstPage + EXECUTABLE_PAGE_SIZE <= (uint64_t) segment.address + segment.size) {
+          position += (segment.address - position) & (EXECUTABLE_PAGE_SIZE - 1);
+      }
+      segment.offset = position;
+      position += segment.size;
   }
-  
-  outFile.close();
-}
 
+  vector<uint8_t> payload(position - payloadStart);
+  size_t segment = 0;
+  for (const auto& pair : memory) {
+      if (pair.first - segments[segment].address >= segments[segment].size) segment++;
+      payload[segments[segment].offset - payloadStart + pair.first - segments[segment].address] = pair.second;
+  }
+
+  ExecutableHeader header = {EXECUTABLE_MAGIC, (uint32_t) segments.size(), (uint32_t) symbols.size(), position};
+  outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  outFile.write(reinterpret_cast<const char*>(segments.data()), segments.size() * sizeof(SegmentHeader));
+  outFile.write(reinterpret_cast<const char*>(payload.data()), payload.size());
 
+  for (const auto& symbol : symbols) {
+      uint32_t nameSize = symbol.first.size();
+      outFile.write(reinterpret_cast<const char*>(&symbol.second), sizeof(symbol.second));
+      outFile.write(reinterpret_cast<const char*>(&nameSize), sizeof(nameSize));
+      outFile.write(symbol.first.data(), nameSize);
+  }
 
+  outFile.close();
+}
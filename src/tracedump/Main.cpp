@@ -0,0 +1,180 @@
+#include "../../inc/emulator/TraceFormat.hpp"
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// Prints the records of a trace written by the emulator's -trace option.
+// Every record is decoded so the register and write state stays exact, the
+// filters only decide what gets printed.
+struct Filter {
+  uint64_t from = 0, to = UINT64_MAX;
+  bool byPc = false, byWrite = false;
+  uint32_t pc = 0, write = 0;
+  bool summary = false;
+};
+
+static void printHex(uint32_t value){
+  cout << "0x" << hex << setw(8) << setfill('0') << value << dec << setfill(' ');
+}
+
+static int dump(const uint8_t* p, const uint8_t* end, const Filter& filter){
+  TraceHeader header;
+  if(end - p < (long) sizeof(header)){
+    cerr << "Trace too short" << endl;
+    return 1;
+  }
+  memcpy(&header, p, sizeof(header));
+  p += sizeof(header);
+  if(header.magic != TRACE_MAGIC){
+    cerr << "Not a trace file" << endl;
+    return 1;
+  }
+
+  uint32_t gpr[16];
+  memcpy(gpr, header.gpr, sizeof(gpr));
+  static uint32_t codes[TRACE_CODE_CACHE];
+  uint32_t pc = header.pc - 4, lastWrite = 0;
+  uint64_t index = 0, printed = 0, writeTotal = 0;
+  uint32_t writes[64][2];
+
+  while(p < end){
+    uint8_t flags = *p++;
+    uint32_t value;
+    if(flags & TRACE_SEQUENTIAL) pc += 4;
+    else{
+      if(!(p = getVarint(p, end, value))) break;
+      pc += unzigzag(value);
+    }
+
+    uint32_t& code = codes[traceSlot(pc)];
+    if(!(flags & TRACE_SAME_CODE)){
+      if(end - p < 4){
+        p = nullptr;
+        break;
+      }
+      memcpy(&code, p, 4);
+      p += 4;
+    }
+
+    uint32_t mask = 0;
+    if(flags & TRACE_REGISTERS){
+      if(!(p = getVarint(p, end, mask))) break;
+      for(int r = 1; r < 15 && p; r++){
+        if(!(mask & (1 << r))) continue;
+        if((p = getVarint(p, end, value))) gpr[r] += unzigzag(value);
+      }
+      if(!p) break;
+    }
+
+    uint32_t writeCount = 0;
+    bool wrote = false;
+    if(flags & TRACE_WRITES){
+      if(!(p = getVarint(p, end, writeCount))) break;
+      for(uint32_t i = 0; i < writeCount && p; i++){
+        uint32_t address, data;
+        if(!(p = getVarint(p, end, address)) || !(p = getVarint(p, end, data))) break;
+        lastWrite += unzigzag(address);
+        if(i < 64){
+          writes[i][0] = lastWrite;
+          writes[i][1] = data;
+        }
+        if(lastWrite == filter.write) wrote = true;
+      }
+      if(!p) break;
+      writeTotal += writeCount;
+    }
+
+    bool show = index >= filter.from && index <= filter.to &&
+                (!filter.byPc || pc == filter.pc) &&
+                (!filter.byWrite || wrote);
+    if(show && !filter.summary){
+      cout << setw(12) << index << "  ";
+      printHex(pc);
+      cout << "  ";
+      printHex(code);
+      for(int r = 1; r < 15; r++){
+        if(mask & (1 << r)){
+          cout << "  r" << r << "=";
+          printHex(gpr[r]);
+        }
+      }
+      for(uint32_t i = 0; i < writeCount && i < 64; i++){
+        cout << "  [";
+        printHex(writes[i][0]);
+        cout << "]=";
+        printHex(writes[i][1]);
+      }
+      cout << '\n';
+    }
+    if(show) printed++;
+    index++;
+  }
+  if(p == nullptr){
+    cerr << "Trace truncated after record " << index << endl;
+  }
+  if(filter.summary){
+    cout << "Records: " << index << endl;
+    cout << "Matching records: " << printed << endl;
+    cout << "Memory writes: " << writeTotal << endl;
+  }
+  return p == nullptr ? 1 : 0;
+}
+
+int main(int argc, char const *argv[]){
+  Filter filter;
+  string inputName;
+  for(int i = 1; i < argc; i++){
+    string arg = argv[i];
+    try
+    {
+      if(arg.substr(0, 4) == "-pc="){
+        filter.byPc = true;
+        filter.pc = stoul(arg.substr(4), nullptr, 0);
+      }
+      else if(arg.substr(0, 7) == "-write="){
+        filter.byWrite = true;
+        filter.write = stoul(arg.substr(7), nullptr, 0);
+      }
+      else if(arg.substr(0, 6) == "-from=") filter.from = stoull(arg.substr(6));
+      else if(arg.substr(0, 4) == "-to=") filter.to = stoull(arg.substr(4));
+      else if(arg == "-summary") filter.summary = true;
+      else if(arg[0] == '-') throw invalid_argument("Unknown option " + arg);
+      else inputName = arg;
+    }
+    catch(const std::exception& e)
+    {
+      cerr << e.what() << endl;
+      return 1;
+    }
+  }
+  if(inputName.empty()){
+    cerr << "Usage: ./tracedump [-from=N] [-to=N] [-pc=addr] [-write=addr] [-summary] traceFileName" << endl;
+    return 1;
+  }
+
+  int fd = open(inputName.c_str(), O_RDONLY);
+  struct stat st;
+  if(fd < 0 || fstat(fd, &st) < 0){
+    cerr << "Failed to open " << inputName << endl;
+    return 1;
+  }
+  size_t size = st.st_size;
+  void* image = size == 0 ? MAP_FAILED : mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(image == MAP_FAILED){
+    cerr << "Trace too short" << endl;
+    return 1;
+  }
+  madvise(image, size, MADV_SEQUENTIAL);
+  const uint8_t* bytes = static_cast<const uint8_t*>(image);
+  int result = dump(bytes, bytes + size, filter);
+  munmap(image, size);
+  return result;
+}
@@ -0,0 +1,27 @@
+# file: alu.s
+# arithmetic and logic in a tight loop
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0, %r1          # i
+    ld $2000000, %r2    # iterations
+    ld $1, %r3
+    ld $3, %r4
+    ld $0x12345, %r5    # accumulator
+    ld $0xFFFF, %r6
+loop:
+    add %r1, %r5
+    mul %r4, %r5
+    xor %r1, %r5
+    shl %r3, %r5
+    shr %r4, %r5
+    and %r6, %r5
+    or %r3, %r5
+    sub %r1, %r5
+    add %r3, %r1
+    bne %r1, %r2, loop
+    halt
+
+.end
@@ -0,0 +1,28 @@
+# file: console.s
+# console output, lines of 64 characters
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $20000, %r7      # lines
+    ld $1, %r1
+    ld $31, %r2
+    ld $0x40, %r3
+    ld $64, %r8
+line:
+    ld $0, %r5          # column
+character:
+    ld %r5, %r4
+    and %r2, %r4
+    add %r3, %r4
+    st %r4, 0xFFFFFF00  # term_out
+    add %r1, %r5
+    bne %r5, %r8, character
+    ld $10, %r4
+    st %r4, 0xFFFFFF00
+    sub %r1, %r7
+    bne %r7, %r0, line
+    halt
+
+.end
@@ -0,0 +1,31 @@
+# file: interrupts.s
+# a storm of software interrupts through the handler
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0x40F00000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $0, %r1          # interrupts handled
+    ld $500000, %r2
+loop:
+    int
+    bne %r1, %r2, loop
+    halt
+
+handler:
+    push %r2
+    push %r3
+    csrrd %cause, %r2
+    ld $4, %r3
+    bne %r2, %r3, finish
+    ld $1, %r3
+    add %r3, %r1
+finish:
+    pop %r3
+    pop %r2
+    iret
+
+.end
@@ -0,0 +1,33 @@
+# file: memcpy.s
+# copies a 4 KiB buffer word by word, back and forth
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $1000, %r7       # passes
+    ld $4, %r5
+    ld $1, %r6
+pass:
+    ld $source, %r1
+    ld $destination, %r2
+    ld $1024, %r3       # words
+copy:
+    ld [%r1], %r4
+    st %r4, [%r2]
+    add %r5, %r1
+    add %r5, %r2
+    sub %r6, %r3
+    bne %r3, %r0, copy
+    xchg %r1, %r2       # copy the other way round next pass
+    sub %r6, %r7
+    bne %r7, %r0, pass
+    halt
+
+.section my_data
+source:
+.skip 4096
+destination:
+.skip 4096
+
+.end
@@ -0,0 +1,32 @@
+# file: recursion.s
+# naive recursive fibonacci, call/ret and the stack
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0x40F00000, %sp
+    ld $27, %r1
+    call fib
+    halt
+
+# r1 <= fib(r1)
+fib:
+    ld $2, %r2
+    bgt %r2, %r1, done  # fib(0) = 0, fib(1) = 1
+    push %r1
+    ld $1, %r2
+    sub %r2, %r1
+    call fib
+    pop %r2
+    push %r1            # fib(n - 1)
+    ld $2, %r3
+    sub %r3, %r2
+    ld %r2, %r1
+    call fib
+    pop %r2
+    add %r2, %r1
+done:
+    ret
+
+.end
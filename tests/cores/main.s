@@ -0,0 +1,113 @@
+# file: main.s
+# the same work on every core: loops hot enough for the jit, the push, pop,
+# call, ret and iret sequences the cached core fuses, software interrupts
+# and code that rewrites itself while it runs
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0x40F00000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+
+# sum of i and xor of i*i for i = 1 .. 19999
+    ld $0, %r1
+    ld $1, %r2
+    ld $1, %r3
+    ld $20000, %r4
+    ld $0, %r5
+squares:
+    add %r2, %r1
+    ld %r2, %r6
+    mul %r6, %r6
+    xor %r6, %r5
+    add %r3, %r2
+    bne %r2, %r4, squares
+    push %r1
+    push %r5
+
+# recursive fibonacci, every call saves and restores two registers
+    ld $20, %r1
+    call fib
+    push %r2
+
+# software interrupts, the handler counts them in r8
+    ld $0, %r8
+    ld $1000, %r4
+storm:
+    int
+    bne %r8, %r4, storm
+
+# halfway through, the add in patched is overwritten with the xor after it
+    ld $0, %r9
+    ld $1, %r11
+    ld $2000, %r10
+    ld $1000, %r12
+rewrite:
+    call patched
+    bne %r10, %r12, unpatched
+    ld replacement, %r13
+    st %r13, patched
+unpatched:
+    sub %r11, %r10
+    bne %r10, %r0, rewrite
+
+    pop %r3
+    pop %r2
+    pop %r1
+    ld $0, %r4
+    ld $0, %r5
+    ld $0, %r6
+    ld $0, %r7
+    ld $0, %r10
+    ld $0, %r11
+    ld $0, %r12
+    ld $0, %r13
+    jmp stop
+
+# r2 = fib(r1)
+fib:
+    ld $2, %r7
+    bgt %r7, %r1, fib_small
+    push %r1
+    push %r3
+    ld $1, %r7
+    sub %r7, %r1
+    call fib
+    ld %r2, %r3
+    ld $1, %r7
+    sub %r7, %r1
+    call fib
+    add %r3, %r2
+    pop %r3
+    pop %r1
+    ret
+fib_small:
+    ld %r1, %r2
+    ret
+
+patched:
+    add %r11, %r9
+    ret
+replacement:
+    xor %r10, %r9
+
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $4, %r2
+    bne %r1, %r2, handler_done
+    ld $1, %r2
+    add %r2, %r8
+handler_done:
+    pop %r2
+    pop %r1
+    iret
+
+.section my_halt
+stop:
+    halt
+
+.end
@@ -0,0 +1,18 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+# the tools report errors but exit 0, so check for their output
+rm -f main.o program.hex
+${ASSEMBLER} -o main.o tests/cores/main.s
+[ -f main.o ] || exit 1
+${LINKER} -hex \
+  -place=my_code@0x40000000 -place=my_halt@0x40001000 \
+  -o program.hex \
+  main.o
+[ -f program.hex ] || exit 1
+# every core has to end in the state in expected.txt
+for core in switch threaded cached jit; do
+  ${EMULATOR} -headless -core=${core} program.hex > program.txt
+  diff tests/cores/expected.txt program.txt || { echo "-core=${core} differs"; exit 1; }
+done
@@ -0,0 +1,135 @@
+# file: main.s
+# dma and disk transfers, each waited for through bit 31 of its control
+# register: r1-r4 hold what the dma moved, r5-r7 what went to the disk and
+# came back, r8 the completion interrupts and r9-r10 the refused transfers
+
+.global my_start
+
+.equ dma_src, 0xFFFFFF30
+.equ dma_dst, 0xFFFFFF34
+.equ dma_len, 0xFFFFFF38
+.equ dma_ctrl, 0xFFFFFF3C
+.equ disk_sector, 0xFFFFFF40
+.equ disk_buffer, 0xFFFFFF44
+.equ disk_count, 0xFFFFFF48
+.equ disk_ctrl, 0xFFFFFF4C
+.equ disk_size, 0xFFFFFF50
+
+.section my_code
+my_start:
+    ld $0x40F00000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $0, %r8
+
+# fill 10000 bytes with 0xAB, interrupt when done
+    ld $0xAB, %r1
+    st %r1, dma_src
+    ld $0x50000000, %r1
+    st %r1, dma_dst
+    ld $10000, %r1
+    st %r1, dma_len
+    ld $7, %r1
+    st %r1, dma_ctrl
+    call dma_wait
+
+# mark the first word, then copy 9000 bytes up by two across pages
+    ld $0x50000000, %r2
+    ld $0x11223344, %r1
+    st %r1, [%r2]
+    ld $0x50000000, %r1
+    st %r1, dma_src
+    ld $0x50000002, %r1
+    st %r1, dma_dst
+    ld $9000, %r1
+    st %r1, dma_len
+    ld $1, %r1
+    st %r1, dma_ctrl
+    call dma_wait
+    ld [%r2], %r1
+    ld [%r2 + 4], %r2
+    ld $0x50002328, %r3
+    ld [%r3], %r3
+    ld dma_len, %r4
+
+# a range reaching the device registers is refused
+    ld $0xFFFFFE00, %r9
+    st %r9, dma_dst
+    ld $0x201, %r9
+    st %r9, dma_len
+    ld $3, %r9
+    st %r9, dma_ctrl
+    ld dma_ctrl, %r9
+
+# write a page of 0xAB to sectors 8-15 and read it back into a page aligned
+# buffer, then its first sector into an unaligned one
+    ld $8, %r5
+    st %r5, disk_sector
+    ld $0x50000000, %r5
+    st %r5, disk_buffer
+    ld $8, %r5
+    st %r5, disk_count
+    ld $7, %r5
+    st %r5, disk_ctrl
+    call disk_wait
+    ld $0x50004000, %r5
+    st %r5, disk_buffer
+    ld $5, %r5
+    st %r5, disk_ctrl
+    call disk_wait
+    ld $1, %r5
+    st %r5, disk_count
+    ld $0x50006004, %r5
+    st %r5, disk_buffer
+    ld $1, %r5
+    st %r5, disk_ctrl
+    call disk_wait
+    ld $0x50004FFC, %r5
+    ld [%r5], %r5
+    ld $0x50006004, %r6
+    ld [%r6 + 508], %r6
+    ld disk_size, %r7
+
+# sectors past the end fail
+    ld disk_size, %r10
+    st %r10, disk_sector
+    ld $1, %r10
+    st %r10, disk_ctrl
+    call disk_wait
+    ld disk_ctrl, %r10
+
+    ld $0, %r11
+    jmp stop
+
+dma_wait:
+    ld dma_ctrl, %r11
+    bgt %r11, %r0, dma_wait
+    ret
+
+disk_wait:
+    ld disk_ctrl, %r11
+    bgt %r11, %r0, disk_wait
+    ret
+
+# counts dma and disk completion interrupts
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $6, %r2
+    beq %r1, %r2, handle_device
+    ld $7, %r2
+    bne %r1, %r2, handler_done
+handle_device:
+    ld $1, %r2
+    add %r2, %r8
+handler_done:
+    pop %r2
+    pop %r1
+    iret
+
+.section my_halt
+stop:
+    halt
+
+.end
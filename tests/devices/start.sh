@@ -0,0 +1,20 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+
+# the tools report errors but exit 0, so check for their output
+rm -f main.o program.hex
+${ASSEMBLER} -o main.o tests/devices/main.s
+[ -f main.o ] || exit 1
+${LINKER} -hex \
+  -place=my_code@0x40000000 -place=my_halt@0x40001000 \
+  -o program.hex \
+  main.o
+[ -f program.hex ] || exit 1
+# the program ends in the state in expected.txt on every core, starting
+# from an empty 64 sector disk each time
+for core in switch threaded cached jit; do
+  dd if=/dev/zero of=disk.img bs=512 count=64 2> /dev/null
+  ${EMULATOR} -headless -core=${core} -disk=disk.img program.hex > program.txt
+  diff tests/devices/expected.txt program.txt || { echo "-core=${core} differs"; exit 1; }
+done
@@ -0,0 +1,86 @@
+# file: main.s
+# a long computation under timer and terminal interrupts, for
+# snapshot/restore and record/replay: a resumed or replayed run has to end
+# where a straight one does
+
+.global my_start
+
+.section my_code
+my_start:
+    ld $0x40F00000, %sp
+    ld $handler, %r1
+    csrwr %r1, %handler
+    ld $0, %r1
+    st %r1, 0xFFFFFF10  # tim_cfg, shortest period
+
+# r1 = sum over i of (i * 7) xor i, the running value kept in memory so
+# restored pages matter as much as restored registers
+    ld $1, %r2
+    ld $1, %r3
+    ld $200000, %r4
+    ld $7, %r7
+    ld $total, %r9
+    st %r0, [%r9]
+loop:
+    ld %r2, %r5
+    mul %r7, %r5
+    xor %r2, %r5
+    ld [%r9], %r6
+    add %r5, %r6
+    st %r6, [%r9]
+    add %r3, %r2
+    bne %r2, %r4, loop
+
+    ld [%r9], %r1
+    ld $ticks, %r9
+    ld [%r9], %r8
+    ld $typed, %r9
+    ld [%r9], %r10
+    ld $0, %r2
+    ld $0, %r3
+    ld $0, %r4
+    ld $0, %r5
+    ld $0, %r6
+    ld $0, %r7
+    ld $0, %r9
+    jmp stop
+
+# counts timer ticks in ticks and adds up the characters typed
+handler:
+    push %r1
+    push %r2
+    csrrd %cause, %r1
+    ld $2, %r2
+    beq %r1, %r2, handle_timer
+    ld $3, %r2
+    beq %r1, %r2, handle_terminal
+    jmp handler_done
+handle_timer:
+    ld ticks, %r1
+    ld $1, %r2
+    add %r2, %r1
+    st %r1, ticks
+    jmp handler_done
+handle_terminal:
+    ld 0xFFFFFF04, %r1  # term_in
+    ld typed, %r2
+    add %r1, %r2
+    st %r2, typed
+handler_done:
+    pop %r2
+    pop %r1
+    iret
+
+.section my_data
+total:
+.word 0
+ticks:
+.word 0
+typed:
+.word 0
+
+.section my_halt
+stop:
+    halt
+
+.end
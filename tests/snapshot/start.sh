@@ -0,0 +1,29 @@
+ASSEMBLER=./assembler
+LINKER=./linker
+EMULATOR=./emulator
+TIMER="-timer=instret -timer-rate=10"
+
+# the tools report errors but exit 0, so check for their output
+rm -f main.o program.hex
+${ASSEMBLER} -o main.o tests/snapshot/main.s
+[ -f main.o ] || exit 1
+${LINKER} -hex \
+  -place=my_code@0x40000000 -place=my_data@0x40000800 -place=my_halt@0x40001000 \
+  -o program.hex \
+  main.o
+[ -f program.hex ] || exit 1
+# a straight run, one that saves a snapshot on the way, one restored from it
+# and a replay of a recorded run all end in the state in expected.txt; the
+# snapshot is taken after three of the typed characters, the restored run
+# is given the same input and must only get the rest
+${EMULATOR} -headless ${TIMER} -input=snapshot program.hex > program.txt
+diff tests/snapshot/expected.txt program.txt || exit 1
+rm -f program.snp
+${EMULATOR} -headless ${TIMER} -input=snapshot -snapshot-at=4000 -snapshot=program.snp program.hex > program.txt
+diff tests/snapshot/expected.txt program.txt || exit 1
+[ -f program.snp ] || exit 1
+${EMULATOR} -headless ${TIMER} -input=snapshot -restore=program.snp program.hex > program.txt
+diff tests/snapshot/expected.txt program.txt || exit 1
+${EMULATOR} -headless ${TIMER} -input=snapshot -record=program.rec program.hex > /dev/null
+${EMULATOR} -headless ${TIMER} -replay=program.rec program.hex > program.txt
+diff tests/snapshot/expected.txt program.txt || exit 1